@@ -0,0 +1,179 @@
+#ifndef COMPILED_MODEL_HPP
+#define COMPILED_MODEL_HPP
+
+#include <vector>
+
+#include "KernelFunction.hpp"
+#include "Model.hpp"
+#include "RandomFeatures.hpp"
+
+// Read-only inference form of a trained Model
+//
+// Holds its own copy of the support vectors (stored row by row), the
+// coefficients Alpha * ModelY, the squared norms of the support vectors and
+// the normalization vectors, without any of the training state. All the
+// prediction methods are const and do not allocate (except Predict, which
+// returns a new array), so a single instance can be shared by any number of
+// threads without locks.
+class CompiledModel
+{
+private:
+
+	ManagedArray sv = NULL;
+	ManagedArray coef = NULL;
+	ManagedArray norms = NULL;
+	ManagedArray w = NULL;
+	ManagedArray param = NULL;
+
+	std::vector<double> min;
+	std::vector<double> max;
+
+	RandomFeatures map;
+
+	KernelType type = KernelType::UNKNOWN;
+	double b = 0.0;
+	int category = 0;
+
+public:
+
+	CompiledModel()
+	{
+
+	}
+
+	// Copy the inference fields of a trained model
+	CompiledModel(Model& model)
+	{
+		auto n = model.ModelX.x;
+		auto nsv = model.ModelX.y;
+
+		sv = ManagedArray(n, nsv, false);
+		coef = ManagedArray(1, nsv, false);
+		norms = ManagedArray(1, nsv, false);
+		w = ManagedArray(model.W.Length(), false);
+		param = ManagedArray(model.KernelParam.Length(), false);
+
+		for (auto j = 0; j < nsv; j++)
+		{
+			for (auto k = 0; k < n; k++)
+			{
+				sv(k, j) = model.ModelX(k, j);
+			}
+
+			coef(j) = model.Alpha(j) * model.ModelY(j);
+			norms(j) = KernelFunction::Dot(&sv(0, j), &sv(0, j), n);
+		}
+
+		for (auto i = 0; i < w.Length(); i++)
+		{
+			w(i) = model.W(i);
+		}
+
+		for (auto i = 0; i < param.Length(); i++)
+		{
+			param(i) = model.KernelParam(i);
+		}
+
+		min = model.Min;
+		max = model.Max;
+
+		map = model.Map;
+
+		type = model.Type;
+		b = model.B;
+		category = model.Category;
+	}
+
+	KernelType Type() const
+	{
+		return type;
+	}
+
+	int Category() const
+	{
+		return category;
+	}
+
+	int Features() const
+	{
+		return map.Active() ? map.Inputs : sv.x;
+	}
+
+	int SupportVectors() const
+	{
+		return sv.y;
+	}
+
+	// Returns true if normalization vectors were saved with the model
+	bool Normalized() const
+	{
+		return !min.empty() && !max.empty();
+	}
+
+	// dst = (x - Min) / (Max - Min) (dst may be the same as x)
+	void Normalize(const double* x, double* dst) const
+	{
+		for (auto k = 0; k < (int)min.size(); k++)
+		{
+			dst[k] = (x[k] - min[k]) / (max[k] - min[k]);
+		}
+	}
+
+	// Decision value of a single example with Features() features
+	double Decision(const double* x) const
+	{
+		auto n = Features();
+
+		if (type == KernelType::LINEAR)
+			return map.Active() ? map.Decision(x, &w(0), b) : KernelFunction::Dot(x, &w(0), n) + b;
+
+		return KernelFunction::Expansion(type, x, &sv(0, 0), &coef(0), &norms(0), SupportVectors(), n, b, param);
+	}
+
+	int Classify(const double* x, double threshold = 0.0) const
+	{
+		return Decision(x) > threshold ? category : 0;
+	}
+
+	// Decision values of rows examples stored row by row
+	void Predict(const double* x, int rows, double* decisions) const
+	{
+		if (type != KernelType::LINEAR)
+		{
+			KernelFunction::Expansion(type, x, rows, &sv(0, 0), &coef(0), &norms(0), SupportVectors(), Features(), b, param, decisions);
+
+			return;
+		}
+
+		for (auto i = 0; i < rows; i++)
+		{
+			decisions[i] = Decision(x + (long long)i * Features());
+		}
+	}
+
+	ManagedArray Predict(const ManagedArray& input) const
+	{
+		auto predictions = ManagedArray(1, input.y);
+
+		Predict(&input(0, 0), input.y, &predictions(0));
+
+		return predictions;
+	}
+
+	void Free()
+	{
+		ManagedOps::Free(sv);
+		ManagedOps::Free(coef);
+		ManagedOps::Free(norms);
+		ManagedOps::Free(w);
+		ManagedOps::Free(param);
+
+		min.clear();
+		max.clear();
+
+		map.Free();
+
+		type = KernelType::UNKNOWN;
+	}
+};
+#endif
@@ -0,0 +1,440 @@
+#ifndef FAST_GAUSS_TRANSFORM_HPP
+#define FAST_GAUSS_TRANSFORM_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "ManagedArray.hpp"
+#include "ManagedOps.hpp"
+
+// Improved Fast Gauss Transform (IFGT)
+//
+// Evaluates G(y) = sum(q(i) * exp(-||y - s(i)||^2 / h^2)), h^2 = 2 * sigma^2,
+// to within an absolute error epsilon. The sources are grouped into K clusters
+// (farthest point clustering) of radius rx and the Gaussian of each cluster is
+// replaced by a truncated Taylor expansion of order p about its center, so
+//
+// G(y) = sum(exp(-||y - c(k)||^2 / h^2) * sum(C(k, a) * ((y - c(k)) / h)^a, |a| < p), ||y - c(k)|| <= ry)
+//
+// The truncation error is bounded by Q * (2^p / p!) * (rx / h)^p * (ry / h)^p
+// and the clusters farther than ry add at most Q * exp(-(ry - rx)^2 / h^2),
+// where Q = sum(|q(i)|). Each query then costs O(K * C(p - 1 + d, d))
+// operations instead of O(number of sources), which pays off in low dimensions.
+// K is limited to about sqrt(number of sources): with more clusters the
+// expansion is no cheaper than the direct sum, and Faster() tells the caller
+// when the estimated cost per query is not well below that of the direct sum.
+//
+// See: V.C. Raykar, C. Yang, R. Duraiswami, and N. Gumerov, "Fast computation of
+// sums of Gaussians in high dimensions". Technical Report CS-TR-4767, Department
+// of Computer Science, University of Maryland, College Park, 2005.
+class FastGaussTransform
+{
+private:
+
+	// Highest expansion order considered
+	static const int ORDER = 30;
+
+	// number of sample queries used to estimate the cost of a clustering
+	static const int SAMPLES = 64;
+
+	int d = 0;
+	int p = 0;
+	int terms = 0;
+	double h = 1.0;
+	double rx = 0.0;
+	double ry = 0.0;
+	double bound = 0.0;
+
+	// estimated operations per query and number of sources
+	double cost = 0.0;
+	int sources = 0;
+
+	// cluster centers (d x K) and coefficients (terms x K)
+	ManagedArray centers = NULL;
+	ManagedArray coefficients = NULL;
+
+	// the monomial of term t is the monomial of parent[t] times variable[t]
+	std::vector<int> parent;
+	std::vector<int> variable;
+
+	// Smallest order p with (2^p / p!) * (rx * ry / h^2)^p <= target, ORDER + 1 if none
+	static int Order(double rx, double ry, double h, double target)
+	{
+		auto r = rx * ry / (h * h);
+		auto error = 1.0;
+
+		for (auto order = 1; order <= ORDER; order++)
+		{
+			error *= 2 * r / order;
+
+			if (error <= target)
+				return order;
+		}
+
+		return ORDER + 1;
+	}
+
+	// Number of multi-indices of d variables with total degree < order
+	static double Terms(int d, int order)
+	{
+		auto count = 1.0;
+
+		for (auto i = 1; i <= d; i++)
+		{
+			count = count * (order - 1 + i) / i;
+		}
+
+		return count;
+	}
+
+	// Monomials of degree < p in (graded) term order
+	void Monomials(const double* dx, double* m) const
+	{
+		m[0] = 1.0;
+
+		for (auto t = 1; t < terms; t++)
+		{
+			m[t] = m[parent[t]] * dx[variable[t]];
+		}
+	}
+
+	// Build the term order along with 2^|a| / a! for each term
+	std::vector<double> Expansion()
+	{
+		parent.assign(1, -1);
+		variable.assign(1, -1);
+
+		auto constants = std::vector<double>(1, 1.0);
+
+		// exponent of each variable and the first term of each degree that ends with variable k
+		auto exponents = std::vector<std::vector<int>>(1, std::vector<int>(d, 0));
+		auto heads = std::vector<int>(d, 0);
+
+		auto end = 1;
+
+		for (auto degree = 1; degree < p; degree++)
+		{
+			for (auto k = 0; k < d; k++)
+			{
+				auto head = heads[k];
+
+				heads[k] = (int)parent.size();
+
+				for (auto t = head; t < end; t++)
+				{
+					auto exponent = exponents[t];
+
+					exponent[k]++;
+
+					parent.push_back(t);
+					variable.push_back(k);
+					exponents.push_back(exponent);
+					constants.push_back(constants[t] * 2.0 / exponent[k]);
+				}
+			}
+
+			end = (int)parent.size();
+		}
+
+		terms = (int)parent.size();
+
+		return constants;
+	}
+
+public:
+
+	int Clusters = 0;
+
+	FastGaussTransform()
+	{
+
+	}
+
+	// Returns the bound on the absolute error of Evaluate
+	double Bound() const
+	{
+		return bound;
+	}
+
+	int Order() const
+	{
+		return p;
+	}
+
+	// Returns true if an expansion within the accuracy was found whose
+	// estimated cost per query is under half of that of the direct sum
+	bool Faster() const
+	{
+		return Clusters > 0 && 2 * cost < (double)sources * (d + 1);
+	}
+
+	// Sources are the rows of x (n x m) with weights q (m values)
+	void Setup(ManagedArray& x, ManagedArray& q, double sigma, double epsilon)
+	{
+		Free();
+
+		d = x.x;
+
+		auto m = x.y;
+
+		sources = m;
+		cost = std::numeric_limits<double>::infinity();
+
+		h = std::sqrt(2.0) * std::abs(sigma);
+
+		auto Q = 0.0;
+
+		for (auto i = 0; i < m; i++)
+		{
+			Q += std::abs(q(i));
+		}
+
+		if (m == 0 || !(h > 0) || !(Q > 0))
+		{
+			Clusters = 0;
+			p = 1;
+			terms = 1;
+
+			return;
+		}
+
+		// split the error evenly between the truncation and the cut-off
+		auto target = epsilon / (2 * Q);
+		auto cutoff = h * std::sqrt(std::log(1.0 / std::min(target, 0.5)));
+
+		// Farthest point clustering: centers are added one at a time and the
+		// clustering with the lowest estimated cost (among K = 1, 2, 4, ... up
+		// to about sqrt(m) clusters) is kept
+		auto limit = std::max(1, std::min(m, (int)std::ceil(std::sqrt((double)m))));
+
+		auto distance = std::vector<double>(m, 0.0);
+		auto seeds = std::vector<int>(1, 0);
+
+		auto best_cost = std::numeric_limits<double>::infinity();
+		auto best_k = 1;
+		auto best_p = 1;
+
+		auto Distance = [&x](int a, int b)
+		{
+			auto d2 = 0.0;
+
+			for (auto k = 0; k < x.x; k++)
+			{
+				auto diff = x(k, a) - x(k, b);
+
+				d2 += diff * diff;
+			}
+
+			return d2;
+		};
+
+		for (auto i = 0; i < m; i++)
+		{
+			distance[i] = Distance(i, 0);
+		}
+
+		for (auto k = 1; k <= m; k++)
+		{
+			auto far = (int)(std::max_element(distance.begin(), distance.end()) - distance.begin());
+			auto radius = std::sqrt(distance[far]);
+
+			if ((k & (k - 1)) == 0 || k == limit)
+			{
+				auto r = radius + cutoff;
+				auto order = Order(radius, r, h, target);
+
+				if (order <= ORDER)
+				{
+					// average number of clusters within r of a sample of the sources
+					auto near = 0.0;
+					auto step = std::max(1, m / SAMPLES);
+					auto samples = 0;
+
+					for (auto i = 0; i < m; i += step)
+					{
+						for (auto c = 0; c < k; c++)
+						{
+							near += Distance(i, seeds[c]) <= r * r ? 1 : 0;
+						}
+
+						samples++;
+					}
+
+					auto cost = near / samples * Terms(d, order) + k * d;
+
+					if (cost < best_cost)
+					{
+						best_cost = cost;
+						best_k = k;
+						best_p = order;
+					}
+				}
+
+				// stop once more clusters no longer lower the cost (with one
+				// source per cluster the expansion is exact with p = 1)
+				if (radius <= 0 || (best_cost < std::numeric_limits<double>::infinity() && k >= 2 * best_k && k >= 16))
+					break;
+			}
+
+			if (k == limit)
+				break;
+
+			seeds.push_back(far);
+
+			for (auto i = 0; i < m; i++)
+			{
+				auto d2 = Distance(i, far);
+
+				distance[i] = std::min(distance[i], d2);
+			}
+		}
+
+		// rebuild the selected clustering
+		Clusters = best_k;
+		p = best_p;
+		cost = best_cost;
+
+		rx = 0.0;
+
+		auto owner = std::vector<int>(m, 0);
+
+		for (auto i = 0; i < m; i++)
+		{
+			auto c = 0;
+			auto dmin = Distance(i, seeds[0]);
+
+			for (auto k = 1; k < Clusters; k++)
+			{
+				auto d2 = Distance(i, seeds[k]);
+
+				if (d2 < dmin)
+				{
+					dmin = d2;
+					c = k;
+				}
+			}
+
+			owner[i] = c;
+
+			rx = std::max(rx, std::sqrt(dmin));
+		}
+
+		ry = rx + cutoff;
+
+		auto constants = Expansion();
+
+		centers = ManagedArray(d, Clusters, false);
+		coefficients = ManagedArray(terms, Clusters);
+
+		for (auto k = 0; k < Clusters; k++)
+		{
+			for (auto j = 0; j < d; j++)
+			{
+				centers(j, k) = x(j, seeds[k]);
+			}
+		}
+
+		auto dx = std::vector<double>(d);
+		auto monomials = std::vector<double>(terms);
+
+		for (auto i = 0; i < m; i++)
+		{
+			auto c = owner[i];
+			auto d2 = 0.0;
+
+			for (auto j = 0; j < d; j++)
+			{
+				dx[j] = (x(j, i) - centers(j, c)) / h;
+
+				d2 += dx[j] * dx[j];
+			}
+
+			Monomials(dx.data(), monomials.data());
+
+			auto w = q(i) * std::exp(-d2);
+			auto C = &coefficients(0, c);
+
+			for (auto t = 0; t < terms; t++)
+			{
+				C[t] += w * monomials[t];
+			}
+		}
+
+		for (auto k = 0; k < Clusters; k++)
+		{
+			for (auto t = 0; t < terms; t++)
+			{
+				coefficients(t, k) *= constants[t];
+			}
+		}
+
+		auto truncation = 1.0;
+
+		for (auto order = 1; order <= p; order++)
+		{
+			truncation *= 2 * (rx * ry / (h * h)) / order;
+		}
+
+		bound = Q * (truncation + std::exp(-(ry - rx) * (ry - rx) / (h * h)));
+	}
+
+	// G(y) for a query y with d features. work must hold d + Terms() values
+	double Evaluate(const double* y, double* work) const
+	{
+		auto dy = work;
+		auto monomials = work + d;
+
+		auto sum = 0.0;
+
+		for (auto k = 0; k < Clusters; k++)
+		{
+			auto d2 = 0.0;
+
+			for (auto j = 0; j < d; j++)
+			{
+				dy[j] = (y[j] - centers(j, k)) / h;
+
+				d2 += dy[j] * dy[j];
+			}
+
+			if (d2 * h * h > ry * ry)
+				continue;
+
+			Monomials(dy, monomials);
+
+			auto C = &coefficients(0, k);
+			auto g = 0.0;
+
+			for (auto t = 0; t < terms; t++)
+			{
+				g += C[t] * monomials[t];
+			}
+
+			sum += g * std::exp(-d2);
+		}
+
+		return sum;
+	}
+
+	int Terms() const
+	{
+		return terms;
+	}
+
+	void Free()
+	{
+		ManagedOps::Free(centers);
+		ManagedOps::Free(coefficients);
+
+		parent.clear();
+		variable.clear();
+
+		Clusters = 0;
+		bound = 0.0;
+		p = 0;
+		terms = 0;
+	}
+};
+#endif
@@ -0,0 +1,325 @@
+#ifndef GEMM_HPP
+#define GEMM_HPP
+
+#include <algorithm>
+#include <vector>
+
+#include "ThreadPool.hpp"
+
+#if defined(USE_BLAS)
+#include <cblas.h>
+#endif
+
+// Runtime selection of the AVX2 / AVX-512 builds of the micro-kernel (GCC and Clang on x86)
+#if !defined(USE_BLAS) && defined(FAST_MATRIX_MULTIPLY) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GEMM_DISPATCH
+#define GEMM_INLINE inline __attribute__((always_inline))
+#else
+#define GEMM_INLINE inline
+#endif
+
+// General matrix multiplication C = op(A) * op(B) on row-major matrices
+//
+// op(A) is m x k, op(B) is k x n and C is m x n, where op(X) = X' if X is
+// transposed, so products with a transposed operand do not need a copy.
+//
+// With FAST_MATRIX_MULTIPLY, op(B) is packed into KC x NC panels and op(A)
+// into MC x KC blocks (both zero padded) laid out in the order they are read by
+// a register-blocked MR x NR micro-kernel, so that the blocks stay in the caches
+// and the innermost loops are contiguous. The rows of C are split into ranges
+// of MC-row blocks, one per thread, and each thread packs its own panels. The
+// micro-kernel is plain C++ left to the compiler's vectorizer; with GCC or
+// Clang on x86 it is also compiled for AVX2 and AVX-512 and the widest one
+// supported by the CPU is used. Without FAST_MATRIX_MULTIPLY the naive triple
+// loop is used.
+//
+// With USE_BLAS the product is computed by cblas_dgemm (link with -lopenblas).
+//
+// See: K. Goto and R.A. van de Geijn, "Anatomy of high-performance matrix
+// multiplication". ACM Transactions on Mathematical Software, 2008. 34(3).
+class Gemm
+{
+private:
+
+	// Micro-kernel tile (rows x columns of C held in registers)
+	enum { MR = 4, NR = 8 };
+
+	// Block sizes of op(A) (MC x KC) and of the op(B) panels (KC x NC)
+	enum { MC = 128, KC = 256, NC = 2048 };
+
+	typedef void (*Kernel)(int mc, int nc, int kc, const double* a, const double* b, double* c, int ldc, bool first);
+
+	// c(0:mr, 0:nr) += a * b over kc packed columns of a (MR values each) and rows of b (NR values each).
+	// The first panel of k overwrites c instead.
+	static GEMM_INLINE void Micro(int kc, const double* a, const double* b, double* c, int ldc, int mr, int nr, bool first)
+	{
+		// one row of accumulators per row of the tile (MR = 4)
+		double c0[NR];
+		double c1[NR];
+		double c2[NR];
+		double c3[NR];
+
+		for (auto j = 0; j < NR; j++)
+		{
+			c0[j] = c1[j] = c2[j] = c3[j] = 0.0;
+		}
+
+		for (auto p = 0; p < kc; p++)
+		{
+			auto ap = a + p * MR;
+			auto bp = b + p * NR;
+
+			auto a0 = ap[0];
+			auto a1 = ap[1];
+			auto a2 = ap[2];
+			auto a3 = ap[3];
+
+			for (auto j = 0; j < NR; j++)
+			{
+				c0[j] += a0 * bp[j];
+				c1[j] += a1 * bp[j];
+				c2[j] += a2 * bp[j];
+				c3[j] += a3 * bp[j];
+			}
+		}
+
+		double* rows[MR] = { c0, c1, c2, c3 };
+
+		for (auto i = 0; i < mr; i++)
+		{
+			auto ci = c + (long long)i * ldc;
+
+			if (first)
+			{
+				for (auto j = 0; j < nr; j++)
+				{
+					ci[j] = rows[i][j];
+				}
+			}
+			else
+			{
+				for (auto j = 0; j < nr; j++)
+				{
+					ci[j] += rows[i][j];
+				}
+			}
+		}
+	}
+
+	// c(0:mc, 0:nc) += a * b for a packed block a and a packed panel b
+	static GEMM_INLINE void Macro(int mc, int nc, int kc, const double* a, const double* b, double* c, int ldc, bool first)
+	{
+		for (auto jr = 0; jr < nc; jr += NR)
+		{
+			for (auto ir = 0; ir < mc; ir += MR)
+			{
+				Micro(kc, a + (long long)ir * kc, b + (long long)jr * kc, c + (long long)ir * ldc + jr, ldc, std::min<int>(MR, mc - ir), std::min<int>(NR, nc - jr), first);
+			}
+		}
+	}
+
+	static void Generic(int mc, int nc, int kc, const double* a, const double* b, double* c, int ldc, bool first)
+	{
+		Macro(mc, nc, kc, a, b, c, ldc, first);
+	}
+
+#if defined(GEMM_DISPATCH)
+
+	__attribute__((target("avx2,fma")))
+	static void AVX2(int mc, int nc, int kc, const double* a, const double* b, double* c, int ldc, bool first)
+	{
+		Macro(mc, nc, kc, a, b, c, ldc, first);
+	}
+
+	__attribute__((target("avx512f")))
+	static void AVX512(int mc, int nc, int kc, const double* a, const double* b, double* c, int ldc, bool first)
+	{
+		Macro(mc, nc, kc, a, b, c, ldc, first);
+	}
+
+#endif
+
+	static Kernel Select()
+	{
+#if defined(GEMM_DISPATCH)
+
+		__builtin_cpu_init();
+
+		if (__builtin_cpu_supports("avx512f"))
+			return AVX512;
+
+		if (__builtin_cpu_supports("avx2"))
+			return AVX2;
+
+#endif
+
+		return Generic;
+	}
+
+	// Pack op(A)(i0:i0 + mc, p0:p0 + kc) into MR-row slivers (column by column)
+	static void PackA(const double* A, int lda, bool transposed, int i0, int mc, int p0, int kc, double* dst)
+	{
+		for (auto ir = 0; ir < mc; ir += MR)
+		{
+			for (auto p = 0; p < kc; p++)
+			{
+				for (auto i = 0; i < MR; i++)
+				{
+					auto row = i0 + ir + i;
+					auto col = p0 + p;
+
+					*dst++ = ir + i < mc ? (transposed ? A[(long long)col * lda + row] : A[(long long)row * lda + col]) : 0.0;
+				}
+			}
+		}
+	}
+
+	// Pack op(B)(p0:p0 + kc, j0:j0 + nc) into NR-column slivers (row by row)
+	static void PackB(const double* B, int ldb, bool transposed, int p0, int kc, int j0, int nc, double* dst)
+	{
+		for (auto jr = 0; jr < nc; jr += NR)
+		{
+			for (auto p = 0; p < kc; p++)
+			{
+				for (auto j = 0; j < NR; j++)
+				{
+					auto row = p0 + p;
+					auto col = j0 + jr + j;
+
+					*dst++ = jr + j < nc ? (transposed ? B[(long long)col * ldb + row] : B[(long long)row * ldb + col]) : 0.0;
+				}
+			}
+		}
+	}
+
+	static void Blocked(int m, int n, int k, const double* A, int lda, bool ta, const double* B, int ldb, bool tb, double* C, int ldc, int threads)
+	{
+		static const Kernel kernel = Select();
+
+		auto blocks = (m + MC - 1) / MC;
+
+		threads = std::max(1, std::min(threads, blocks));
+
+		auto pool = ThreadPool(threads);
+
+		// each worker computes a contiguous range of MC-row blocks over all the panels,
+		// packing op(B) and its blocks of op(A) into buffers of its own
+		for (auto t = 0; t < threads; t++)
+		{
+			auto b0 = (int)((long long)blocks * t / threads);
+			auto b1 = (int)((long long)blocks * (t + 1) / threads);
+
+			pool.Submit([=]()
+			{
+				auto panel = std::vector<double>((size_t)std::min<int>(k, KC) * (std::min<int>(n, NC) + NR));
+				auto block = std::vector<double>((size_t)std::min<int>(k, KC) * (MC + MR));
+
+				for (auto j0 = 0; j0 < n; j0 += NC)
+				{
+					auto nc = std::min<int>(NC, n - j0);
+
+					for (auto p0 = 0; p0 < k; p0 += KC)
+					{
+						auto kc = std::min<int>(KC, k - p0);
+
+						PackB(B, ldb, tb, p0, kc, j0, nc, panel.data());
+
+						for (auto b = b0; b < b1; b++)
+						{
+							auto i0 = b * MC;
+							auto mc = std::min<int>(MC, m - i0);
+
+							PackA(A, lda, ta, i0, mc, p0, kc, block.data());
+
+							kernel(mc, nc, kc, block.data(), panel.data(), C + (long long)i0 * ldc + j0, ldc, p0 == 0);
+						}
+					}
+				}
+			});
+		}
+
+		pool.Run();
+	}
+
+public:
+
+	// C = op(A) * op(B), where op(A) is m x k, op(B) is k x n and C is m x n (leading dimensions lda, ldb and ldc)
+	static void Multiply(int m, int n, int k, const double* A, int lda, bool ta, const double* B, int ldb, bool tb, double* C, int ldc, int threads = 1)
+	{
+		if (m <= 0 || n <= 0)
+			return;
+
+#if !defined(FAST_MATRIX_MULTIPLY) || defined(USE_BLAS)
+
+		// only the blocked version is threaded
+		(void)threads;
+
+#endif
+
+#if defined(USE_BLAS)
+
+		if (k > 0)
+		{
+			cblas_dgemm(CblasRowMajor, ta ? CblasTrans : CblasNoTrans, tb ? CblasTrans : CblasNoTrans, m, n, k, 1.0, A, lda, B, ldb, 0.0, C, ldc);
+
+			return;
+		}
+
+#endif
+
+		if (k <= 0)
+		{
+			for (auto i = 0; i < m; i++)
+			{
+				for (auto j = 0; j < n; j++)
+				{
+					C[(long long)i * ldc + j] = 0.0;
+				}
+			}
+
+			return;
+		}
+
+#if defined(FAST_MATRIX_MULTIPLY) && !defined(USE_BLAS)
+
+		Blocked(m, n, k, A, lda, ta, B, ldb, tb, C, ldc, threads);
+
+#elif !defined(USE_BLAS)
+
+		// Naive version (i-k-j order, so the innermost loop runs along the rows of C and, unless transposed, of B)
+		for (auto i = 0; i < m; i++)
+		{
+			auto ci = C + (long long)i * ldc;
+
+			for (auto j = 0; j < n; j++)
+			{
+				ci[j] = 0.0;
+			}
+
+			for (auto p = 0; p < k; p++)
+			{
+				auto aip = ta ? A[(long long)p * lda + i] : A[(long long)i * lda + p];
+
+				if (tb)
+				{
+					for (auto j = 0; j < n; j++)
+					{
+						ci[j] += aip * B[(long long)j * ldb + p];
+					}
+				}
+				else
+				{
+					auto bp = B + (long long)p * ldb;
+
+					for (auto j = 0; j < n; j++)
+					{
+						ci[j] += aip * bp[j];
+					}
+				}
+			}
+		}
+
+#endif
+	}
+};
+#endif
@@ -0,0 +1,268 @@
+#ifndef KD_TREE_HPP
+#define KD_TREE_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "KernelFunction.hpp"
+#include "Model.hpp"
+
+// KD-tree over the support vectors of a Gaussian (or Radial) model
+//
+// Each node keeps the bounding box of its support vectors and the sum of
+// their |Alpha * ModelY|. Since the kernel decreases with the distance, the
+// largest kernel value of any support vector in a node is K(dmin), where dmin
+// is the distance from the query to the node's box. Nodes with K(dmin) below
+// epsilon are skipped, and K(dmin) * sum(|Alpha * ModelY|) is added to the
+// error bound of the decision value. On low dimensional data the cost of a
+// query then depends on the number of support vectors near it.
+class KDTree
+{
+private:
+
+	// Maximum number of support vectors in a leaf
+	static const int LEAF = 16;
+
+	// Maximum depth of the traversal stack (the tree is balanced)
+	static const int STACK = 128;
+
+	struct Node
+	{
+		int Begin;
+		int End;
+		int Left;
+		int Right;
+		double Sum;
+	};
+
+	std::vector<Node> nodes;
+
+	// bounding box of each node: n lower bounds followed by n upper bounds
+	std::vector<double> bounds;
+
+	// support vectors in tree order and their coefficients
+	ManagedArray X = NULL;
+	ManagedArray Coef = NULL;
+
+	KernelType type = KernelType::UNKNOWN;
+	double gamma = 0.0;
+	double b = 0.0;
+	int n = 0;
+
+	int Build(ManagedArray& sv, ManagedArray& coef, std::vector<int>& index, int begin, int end)
+	{
+		auto id = (int)nodes.size();
+
+		Node node = { begin, end, -1, -1, 0.0 };
+
+		nodes.push_back(node);
+
+		bounds.resize(nodes.size() * 2 * n);
+
+		auto lo = &bounds[(size_t)id * 2 * n];
+		auto hi = lo + n;
+
+		for (auto k = 0; k < n; k++)
+		{
+			lo[k] = hi[k] = sv(k, index[begin]);
+		}
+
+		auto sum = 0.0;
+
+		for (auto i = begin; i < end; i++)
+		{
+			for (auto k = 0; k < n; k++)
+			{
+				lo[k] = std::min(lo[k], sv(k, index[i]));
+				hi[k] = std::max(hi[k], sv(k, index[i]));
+			}
+
+			sum += std::abs(coef(index[i]));
+		}
+
+		nodes[id].Sum = sum;
+
+		// split unless the node is small enough (or all its support vectors are equal)
+		if (end - begin > LEAF)
+		{
+			// split the widest dimension at the median
+			auto dim = 0;
+
+			for (auto k = 1; k < n; k++)
+			{
+				if (hi[k] - lo[k] > hi[dim] - lo[dim])
+					dim = k;
+			}
+
+			auto mid = begin + (end - begin) / 2;
+
+			std::nth_element(index.begin() + begin, index.begin() + mid, index.begin() + end, [&sv, dim](int a, int c) { return sv(dim, a) < sv(dim, c); });
+
+			// lo and hi are invalidated when the children are added
+			if (hi[dim] > lo[dim])
+			{
+				auto left = Build(sv, coef, index, begin, mid);
+				auto right = Build(sv, coef, index, mid, end);
+
+				nodes[id].Left = left;
+				nodes[id].Right = right;
+			}
+		}
+
+		return id;
+	}
+
+	double Kernel(double d2) const
+	{
+		return KernelFunction::RBF(type, gamma, d2);
+	}
+
+	// Squared distance from x to the bounding box of node
+	double MinDistance(const double* x, int node) const
+	{
+		auto lo = &bounds[(size_t)node * 2 * n];
+		auto hi = lo + n;
+
+		auto d2 = 0.0;
+
+		for (auto k = 0; k < n; k++)
+		{
+			auto d = x[k] < lo[k] ? lo[k] - x[k] : (x[k] > hi[k] ? x[k] - hi[k] : 0.0);
+
+			d2 += d * d;
+		}
+
+		return d2;
+	}
+
+public:
+
+	int Category = 0;
+
+	KDTree()
+	{
+
+	}
+
+	int Nodes() const
+	{
+		return (int)nodes.size();
+	}
+
+	// Index the support vectors of a trained Gaussian or Radial model.
+	// Returns false for other kernels.
+	bool Setup(Model& model)
+	{
+		Free();
+
+		if (!model.Trained || (model.Type != KernelType::GAUSSIAN && model.Type != KernelType::RADIAL))
+			return false;
+
+		auto nsv = model.ModelX.y;
+
+		n = model.ModelX.x;
+		type = model.Type;
+		b = model.B;
+		Category = model.Category;
+
+		auto sigma = model.KernelParam.Length() > 0 ? model.KernelParam(0) : 1;
+
+		gamma = KernelFunction::Gamma(sigma);
+
+		X = ManagedArray(n, nsv, false);
+		Coef = ManagedArray(1, nsv, false);
+
+		if (nsv == 0)
+			return true;
+
+		auto coef = ManagedArray(1, nsv, false);
+
+		for (auto j = 0; j < nsv; j++)
+		{
+			coef(j) = model.Alpha(j) * model.ModelY(j);
+		}
+
+		auto index = std::vector<int>(nsv);
+
+		for (auto j = 0; j < nsv; j++)
+		{
+			index[j] = j;
+		}
+
+		Build(model.ModelX, coef, index, 0, nsv);
+
+		for (auto j = 0; j < nsv; j++)
+		{
+			for (auto k = 0; k < n; k++)
+			{
+				X(k, j) = model.ModelX(k, index[j]);
+			}
+
+			Coef(j) = coef(index[j]);
+		}
+
+		ManagedOps::Free(coef);
+
+		return true;
+	}
+
+	// Decision value of x, skipping nodes whose largest kernel value is below epsilon.
+	// error receives a bound on |exact - returned| decision value.
+	double Decision(const double* x, double epsilon, double& error) const
+	{
+		auto sum = b;
+
+		error = 0.0;
+
+		if (nodes.empty())
+			return sum;
+
+		int stack[STACK];
+		int top = 0;
+
+		stack[top++] = 0;
+
+		while (top > 0)
+		{
+			auto id = stack[--top];
+			auto& node = nodes[id];
+
+			auto kmax = Kernel(MinDistance(x, id));
+
+			if (kmax < epsilon)
+			{
+				error += kmax * node.Sum;
+
+				continue;
+			}
+
+			if (node.Left < 0 || top + 2 > STACK)
+			{
+				for (auto j = node.Begin; j < node.End; j++)
+				{
+					sum += Coef(j) * Kernel(KernelFunction::SquaredDiff(x, &X(0, j), n));
+				}
+			}
+			else
+			{
+				stack[top++] = node.Right;
+				stack[top++] = node.Left;
+			}
+		}
+
+		return sum;
+	}
+
+	void Free()
+	{
+		ManagedOps::Free(X);
+		ManagedOps::Free(Coef);
+
+		nodes.clear();
+		bounds.clear();
+
+		type = KernelType::UNKNOWN;
+	}
+};
+#endif
@@ -1,7 +1,9 @@
 #ifndef KERNEL_FUNCTION_HPP
 #define KERNEL_FUNCTION_HPP
 
+#include <algorithm>
 #include <cmath>
+#include <limits>
 
 #include "KernelTypes.hpp"
 #include "ManagedMatrix.hpp"
@@ -10,37 +12,26 @@ class KernelFunction
 {
 public:
 
-	static void Vectorize(ManagedArray& x1, ManagedArray& x2)
+	// Kernels on raw vectors of length n (no allocations, safe to call concurrently)
+	static double Dot(const double* x1, const double* x2, int n)
 	{
-		// Reshape into column vectors
-		ManagedMatrix::Vector(x1);
-		ManagedMatrix::Vector(x2);
-	}
-
-	static double Multiply(ManagedArray& x1, ManagedArray& x2)
-	{
-		Vectorize(x1, x2);
-
-		auto tx = ManagedMatrix::Transpose(x1);
-		auto xx = ManagedMatrix::Multiply(tx, x2);
-
-		auto x = xx(0);
+		double x = 0;
 
-		ManagedOps::Free(tx);
-		ManagedOps::Free(xx);
+		for (auto i = 0; i < n; i++)
+		{
+			x += x1[i] * x2[i];
+		}
 
 		return x;
 	}
 
-	static double SquaredDiff(ManagedArray& x1, ManagedArray& x2)
+	static double SquaredDiff(const double* x1, const double* x2, int n)
 	{
-		Vectorize(x1, x2);
-
 		double x = 0;
 
-		for (auto i = 0; i < x1.Length(); i++)
+		for (auto i = 0; i < n; i++)
 		{
-			auto d = x1(i) - x2(i);
+			auto d = x1[i] - x2[i];
 
 			x += d * d;
 		}
@@ -48,113 +39,404 @@ public:
 		return x;
 	}
 
-	static double Linear(ManagedArray& x1, ManagedArray& x2, ManagedArray& k)
+	// The RBF kernels are exp(-gamma * d) of the squared distance d (Gaussian) or of
+	// its square root (Radial). sigma = 0 gives gamma = inf: K = 1 at d = 0, 0 elsewhere
+	static double Gamma(double sigma)
 	{
-		auto x = Multiply(x1, x2);
-
-		double m = k.Length() > 0 ? k(0) : 1;
-		double b = k.Length() > 1 ? k(1) : 0;
-
-		return x * m + b;
+		return std::abs(sigma) > 0 ? 1 / (2 * sigma * sigma) : std::numeric_limits<double>::infinity();
 	}
 
-	static double Polynomial(ManagedArray& x1, ManagedArray& x2, ManagedArray& k)
+	static double RBF(KernelType type, double gamma, double d)
 	{
-		double b = k.Length() > 0 ? k(0) : 0;
-		double a = k.Length() > 1 ? k(1) : 1;
+		// guard against cancellation for (nearly) identical examples
+		d = d > 0 ? d : 0;
+
+		if (type == KernelType::RADIAL)
+			d = std::sqrt(d);
 
-		return std::pow(Multiply(x1, x2) + b, a);
+		return d > 0 ? std::exp(-gamma * d) : 1.0;
 	}
 
-	static double Gaussian(ManagedArray& x1, ManagedArray& x2, ManagedArray& k)
+	// Kernel functors: the parameters are read once on construction and
+	// operator() evaluates the kernel on two rows of n values. Loops templated
+	// on a functor are compiled (and inlined) separately for each kernel, so
+	// the kernel type is only checked once per loop instead of once per value.
+	//
+	// The kernels that only depend on the dot product also provide FromDot, so
+	// that blocks of kernel values can be computed from a matrix product.
+	struct LinearKernel
 	{
-		auto x = SquaredDiff(x1, x2);
+		double m;
+		double b;
 
-		double sigma = k.Length() > 0 ? k(0) : 1;
+		LinearKernel(const ManagedArray& k) : m(k.Length() > 0 ? k(0) : 1), b(k.Length() > 1 ? k(1) : 0) { }
 
-		double denum = 2 * sigma * sigma;
+		double FromDot(double dot, int /* n */) const
+		{
+			return dot * m + b;
+		}
 
-		return std::abs(denum) > 0 ? std::exp(-x / denum) : 0;
-	}
+		double operator()(const double* x1, const double* x2, int n) const
+		{
+			return FromDot(Dot(x1, x2, n), n);
+		}
+	};
 
-	static double Radial(ManagedArray& x1, ManagedArray& x2, ManagedArray& k)
+	struct PolynomialKernel
 	{
-		double sigma = k.Length() > 0 ? k(0) : 1;
+		// Highest integer degree computed by repeated multiplication
+		static const int DEGREE = 16;
 
-		double denum = 2 * sigma * sigma;
+		double b;
+		double a;
 
-		return std::abs(denum) > 0 ? std::exp(-std::sqrt(SquaredDiff(x1, x2)) / denum) : 0;
-	}
+		// a as an integer (-1 if it is not one, or above DEGREE)
+		int degree;
 
-	static double Sigmoid(ManagedArray& x1, ManagedArray& x2, ManagedArray& k)
-	{
-		double m = k.Length() > 0 ? k(0) : 1;
-		double b = k.Length() > 1 ? k(1) : 0;
+		PolynomialKernel(const ManagedArray& k) : b(k.Length() > 0 ? k(0) : 0), a(k.Length() > 1 ? k(1) : 1)
+		{
+			degree = a >= 0 && a <= DEGREE && a == std::floor(a) ? (int)a : -1;
+		}
 
-		return std::tanh(m * Multiply(x1, x2) / x1.Length() + b);
-	}
+		double FromDot(double dot, int /* n */) const
+		{
+			auto x = dot + b;
 
-	static double Fourier(ManagedArray& x1, ManagedArray& x2, ManagedArray& k)
-	{
-		Vectorize(x1, x2);
+			if (degree < 0)
+				return std::pow(x, a);
+
+			// exponentiation by squaring
+			auto result = 1.0;
 
-		auto z = ManagedArray(x1);
+			for (auto e = degree; e > 0; e >>= 1)
+			{
+				if (e & 1)
+					result *= x;
 
-		double prod = 0;
+				x *= x;
+			}
 
-		double m = k.Length() > 0 ? k(0) : 1;
+			return result;
+		}
 
-		for (auto i = 0; i < x1.Length(); i++)
+		double operator()(const double* x1, const double* x2, int n) const
 		{
-			z(i) = std::sin(m + 0.5) * 2;
+			return FromDot(Dot(x1, x2, n), n);
+		}
+	};
 
-			auto d = x1(i) - x2(i);
+	struct GaussianKernel
+	{
+		double gamma;
 
-			z(i) = std::abs(d) > 0 ? std::sin(m + 0.5) * d / std::sin(d * 0.5) : z(i);
+		GaussianKernel(const ManagedArray& k)
+		{
+			double sigma = k.Length() > 0 ? k(0) : 1;
 
-			prod = (i == 0) ? z(i) : prod * z(i);
+			gamma = Gamma(sigma);
 		}
 
-		ManagedOps::Free(z);
+		double operator()(const double* x1, const double* x2, int n) const
+		{
+			return RBF(KernelType::GAUSSIAN, gamma, SquaredDiff(x1, x2, n));
+		}
+	};
 
-		return prod;
-	}
+	struct RadialKernel
+	{
+		double gamma;
 
-	static double Run(KernelType type, ManagedArray& x1, ManagedArray& x2, ManagedArray& k)
+		RadialKernel(const ManagedArray& k)
+		{
+			double sigma = k.Length() > 0 ? k(0) : 1;
+
+			gamma = Gamma(sigma);
+		}
+
+		double operator()(const double* x1, const double* x2, int n) const
+		{
+			return RBF(KernelType::RADIAL, gamma, SquaredDiff(x1, x2, n));
+		}
+	};
+
+	struct SigmoidKernel
 	{
-		double result = 0;
+		double m;
+		double b;
+
+		SigmoidKernel(const ManagedArray& k) : m(k.Length() > 0 ? k(0) : 1), b(k.Length() > 1 ? k(1) : 0) { }
+
+		double FromDot(double dot, int n) const
+		{
+			return std::tanh(m * dot / n + b);
+		}
 
-		if (type == KernelType::LINEAR)
+		double operator()(const double* x1, const double* x2, int n) const
 		{
-			result = Linear(x1, x2, k);
+			return FromDot(Dot(x1, x2, n), n);
 		}
+	};
+
+	// The Fourier kernel is the product over the features of
+	// z(d) = sin(m + 0.5) * d / sin(d / 2) (2 sin(m + 0.5) for d = 0), d = x1 - x2.
+	// The differences of a block of features (or of a row against a tile of
+	// rows) are computed first so that the sines are evaluated in a separate
+	// contiguous loop, which compilers can vectorize with their vector math
+	// libraries, and sin(m + 0.5) is computed once.
+	struct FourierKernel
+	{
+		// Features per block
+		enum { BLOCK = 64 };
 
-		if (type == KernelType::GAUSSIAN)
+		double m;
+		double s;
+
+		FourierKernel(const ManagedArray& k) : m(k.Length() > 0 ? k(0) : 1)
 		{
-			result = Gaussian(x1, x2, k);
+			s = std::sin(m + 0.5);
 		}
 
-		if (type == KernelType::FOURIER)
+		double operator()(const double* x1, const double* x2, int n) const
 		{
-			result = Fourier(x1, x2, k);
+			double d[BLOCK];
+			double sn[BLOCK];
+
+			double prod = n > 0 ? 1 : 0;
+
+			for (auto i0 = 0; i0 < n; i0 += BLOCK)
+			{
+				auto w = std::min<int>(BLOCK, n - i0);
+
+				for (auto i = 0; i < w; i++)
+				{
+					d[i] = x1[i0 + i] - x2[i0 + i];
+				}
+
+				for (auto i = 0; i < w; i++)
+				{
+					sn[i] = std::sin(d[i] * 0.5);
+				}
+
+				for (auto i = 0; i < w; i++)
+				{
+					prod *= std::abs(d[i]) > 0 ? s * d[i] / sn[i] : s * 2;
+				}
+			}
+
+			return prod;
 		}
 
-		if (type == KernelType::SIGMOID)
+		// out(c) = K(x, y(c)) for w vectors y(c) stored transposed (feature k of
+		// y(c) at yt[k * stride + c]). work must hold 2 * w values
+		void Row(const double* x, const double* yt, int stride, int w, int n, double* out, double* work) const
 		{
-			result = Sigmoid(x1, x2, k);
+			auto d = work;
+			auto sn = work + w;
+
+			for (auto c = 0; c < w; c++)
+			{
+				out[c] = n > 0 ? 1 : 0;
+			}
+
+			for (auto k = 0; k < n; k++)
+			{
+				auto xk = x[k];
+				auto y = yt + (long long)k * stride;
+
+				for (auto c = 0; c < w; c++)
+				{
+					d[c] = xk - y[c];
+				}
+
+				for (auto c = 0; c < w; c++)
+				{
+					sn[c] = std::sin(d[c] * 0.5);
+				}
+
+				for (auto c = 0; c < w; c++)
+				{
+					out[c] *= std::abs(d[c]) > 0 ? s * d[c] / sn[c] : s * 2;
+				}
+			}
 		}
+	};
 
-		if (type == KernelType::RADIAL)
+	static double Linear(const double* x1, const double* x2, int n, const ManagedArray& k)
+	{
+		return LinearKernel(k)(x1, x2, n);
+	}
+
+	static double Polynomial(const double* x1, const double* x2, int n, const ManagedArray& k)
+	{
+		return PolynomialKernel(k)(x1, x2, n);
+	}
+
+	static double Gaussian(const double* x1, const double* x2, int n, const ManagedArray& k)
+	{
+		return GaussianKernel(k)(x1, x2, n);
+	}
+
+	static double Radial(const double* x1, const double* x2, int n, const ManagedArray& k)
+	{
+		return RadialKernel(k)(x1, x2, n);
+	}
+
+	static double Sigmoid(const double* x1, const double* x2, int n, const ManagedArray& k)
+	{
+		return SigmoidKernel(k)(x1, x2, n);
+	}
+
+	static double Fourier(const double* x1, const double* x2, int n, const ManagedArray& k)
+	{
+		return FourierKernel(k)(x1, x2, n);
+	}
+
+	static double Run(KernelType type, const double* x1, const double* x2, int n, const ManagedArray& k)
+	{
+		switch (type)
+		{
+		case KernelType::LINEAR:
+			return Linear(x1, x2, n, k);
+		case KernelType::GAUSSIAN:
+			return Gaussian(x1, x2, n, k);
+		case KernelType::FOURIER:
+			return Fourier(x1, x2, n, k);
+		case KernelType::SIGMOID:
+			return Sigmoid(x1, x2, n, k);
+		case KernelType::RADIAL:
+			return Radial(x1, x2, n, k);
+		case KernelType::POLYNOMIAL:
+			return Polynomial(x1, x2, n, k);
+		default:
+			return 0;
+		}
+	}
+
+	// out(r) = b + sum(coef(j) * K(x(r), sv(j))) for rows inputs stored row by row in x
+	template <typename Kernel>
+	static void Expansion(const Kernel& kernel, const double* x, int rows, const double* sv, const double* coef, int nsv, int n, double b, double* out)
+	{
+		for (auto r = 0; r < rows; r++)
+		{
+			auto xr = x + (long long)r * n;
+			auto sum = b;
+
+			for (auto j = 0; j < nsv; j++)
+			{
+				sum += coef[j] * kernel(xr, sv + (long long)j * n, n);
+			}
+
+			out[r] = sum;
+		}
+	}
+
+	// RBF kernels: ||x - sv(j)||^2 = ||x||^2 + ||sv(j)||^2 - 2 x . sv(j)
+	static double ExpansionRBF(KernelType type, const double* x, const double* sv, const double* coef, const double* norms, int nsv, int n, double b, const ManagedArray& k)
+	{
+		auto sum = b;
+
+		double sigma = k.Length() > 0 ? k(0) : 1;
+
+		auto gamma = Gamma(sigma);
+
+		auto nx = Dot(x, x, n);
+
+		for (auto j = 0; j < nsv; j++)
 		{
-			result = Radial(x1, x2, k);
+			sum += coef[j] * RBF(type, gamma, nx + norms[j] - 2 * Dot(x, sv + (long long)j * n, n));
 		}
 
-		if (type == KernelType::POLYNOMIAL)
+		return sum;
+	}
+
+	// Kernel expansions of rows inputs (x is rows x n) over nsv support vectors stored
+	// row by row in sv. norms holds ||sv(j)||^2 (used by the RBF kernels only)
+	static void Expansion(KernelType type, const double* x, int rows, const double* sv, const double* coef, const double* norms, int nsv, int n, double b, const ManagedArray& k, double* out)
+	{
+		switch (type)
 		{
-			result = Polynomial(x1, x2, k);
+		case KernelType::GAUSSIAN:
+		case KernelType::RADIAL:
+			for (auto r = 0; r < rows; r++)
+			{
+				out[r] = ExpansionRBF(type, x + (long long)r * n, sv, coef, norms, nsv, n, b, k);
+			}
+			break;
+		case KernelType::LINEAR:
+			Expansion(LinearKernel(k), x, rows, sv, coef, nsv, n, b, out);
+			break;
+		case KernelType::POLYNOMIAL:
+			Expansion(PolynomialKernel(k), x, rows, sv, coef, nsv, n, b, out);
+			break;
+		case KernelType::SIGMOID:
+			Expansion(SigmoidKernel(k), x, rows, sv, coef, nsv, n, b, out);
+			break;
+		case KernelType::FOURIER:
+			Expansion(FourierKernel(k), x, rows, sv, coef, nsv, n, b, out);
+			break;
+		default:
+			for (auto r = 0; r < rows; r++)
+			{
+				out[r] = b;
+			}
 		}
+	}
+
+	// Kernel expansion b + sum(coef(j) * K(x, sv(j))) of a single input
+	static double Expansion(KernelType type, const double* x, const double* sv, const double* coef, const double* norms, int nsv, int n, double b, const ManagedArray& k)
+	{
+		auto sum = b;
+
+		Expansion(type, x, 1, sv, coef, norms, nsv, n, b, k, &sum);
 
-		return result;
+		return sum;
+	}
+
+	// The ManagedArray overloads treat their arguments as vectors of x1.Length()
+	// values and evaluate the kernels on the raw data (no reshaping or copies)
+	static double Multiply(ManagedArray& x1, ManagedArray& x2)
+	{
+		return Dot(&x1(0), &x2(0), x1.Length());
+	}
+
+	static double SquaredDiff(ManagedArray& x1, ManagedArray& x2)
+	{
+		return SquaredDiff(&x1(0), &x2(0), x1.Length());
+	}
+
+	static double Linear(ManagedArray& x1, ManagedArray& x2, ManagedArray& k)
+	{
+		return Linear(&x1(0), &x2(0), x1.Length(), k);
+	}
+
+	static double Polynomial(ManagedArray& x1, ManagedArray& x2, ManagedArray& k)
+	{
+		return Polynomial(&x1(0), &x2(0), x1.Length(), k);
+	}
+
+	static double Gaussian(ManagedArray& x1, ManagedArray& x2, ManagedArray& k)
+	{
+		return Gaussian(&x1(0), &x2(0), x1.Length(), k);
+	}
+
+	static double Radial(ManagedArray& x1, ManagedArray& x2, ManagedArray& k)
+	{
+		return Radial(&x1(0), &x2(0), x1.Length(), k);
+	}
+
+	static double Sigmoid(ManagedArray& x1, ManagedArray& x2, ManagedArray& k)
+	{
+		return Sigmoid(&x1(0), &x2(0), x1.Length(), k);
+	}
+
+	static double Fourier(ManagedArray& x1, ManagedArray& x2, ManagedArray& k)
+	{
+		return Fourier(&x1(0), &x2(0), x1.Length(), k);
+	}
+
+	static double Run(KernelType type, ManagedArray& x1, ManagedArray& x2, ManagedArray& k)
+	{
+		return Run(type, &x1(0), &x2(0), x1.Length(), k);
 	}
 };
 #endif
@@ -0,0 +1,470 @@
+#ifndef KERNEL_MATRIX_HPP
+#define KERNEL_MATRIX_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "KernelFunction.hpp"
+#include "SymmetricMatrix.hpp"
+#include "ThreadPool.hpp"
+
+// Read-only training set and its Gram matrix
+//
+// K depends only on the inputs, the kernel type and the kernel parameters
+// (never on the labels) so a single instance can be computed once and
+// referenced by every one-vs-rest Model trained on the same data
+class KernelMatrix
+{
+private:
+
+	// Tile size (rows x columns) used when building K
+	static const int TILE = 64;
+
+	// Kernel parameters used by the Linear and RBF kernels
+	double slope = 1.0;
+	double inter = 0.0;
+	double gamma = 0.0;
+
+	// Returns true for the kernels computed from the squared distance
+	bool RBF()
+	{
+		return Type == KernelType::GAUSSIAN || Type == KernelType::RADIAL;
+	}
+
+	// K(i, j) from the squared distance d = ||xi||^2 + ||xj||^2 - 2 xi.xj
+	double Distance(double d)
+	{
+		return KernelFunction::RBF(Type, gamma, d);
+	}
+
+	// Store K(r, c) and K(c, r) (packed storage only keeps the upper triangle)
+	void Store(int r, int c, double value)
+	{
+		if (Single)
+		{
+			if (Packed())
+			{
+				PS(c, r) = (float)value;
+			}
+			else
+			{
+				KS[(size_t)r * Rows() + c] = (float)value;
+				KS[(size_t)c * Rows() + r] = (float)value;
+			}
+		}
+		else
+		{
+			if (Packed())
+			{
+				P(c, r) = value;
+			}
+			else
+			{
+				K(c, r) = value;
+				K(r, c) = value;
+			}
+		}
+	}
+
+	// Compute the upper triangle of the tile K(c0:c1, r0:r1) and mirror it
+	void Tile(int r0, int r1, int c0, int c1)
+	{
+		switch (Type)
+		{
+		case KernelType::GAUSSIAN:
+		case KernelType::RADIAL:
+			TileRBF(r0, r1, c0, c1);
+			break;
+		case KernelType::LINEAR:
+			TileDot(KernelFunction::LinearKernel(Param), r0, r1, c0, c1);
+			break;
+		case KernelType::POLYNOMIAL:
+			TileDot(KernelFunction::PolynomialKernel(Param), r0, r1, c0, c1);
+			break;
+		case KernelType::SIGMOID:
+			TileDot(KernelFunction::SigmoidKernel(Param), r0, r1, c0, c1);
+			break;
+		case KernelType::FOURIER:
+			TileFourier(r0, r1, c0, c1);
+			break;
+		default:
+			break;
+		}
+	}
+
+	// Column i of the kernel matrix specialized for a kernel functor
+	template <typename Kernel, typename T>
+	void Column(const Kernel& kernel, int i, T* dst)
+	{
+		auto n = Cols();
+		auto m = Rows();
+
+		for (auto j = 0; j < m; j++)
+		{
+			dst[j] = (T)kernel(&X(0, i), &X(0, j), n);
+		}
+	}
+
+	// Rows c0:c1 of X transposed into a (c1 - c0) x n block
+	ManagedArray Columns(int c0, int c1)
+	{
+		auto n = Cols();
+
+		auto Xt = ManagedArray(c1 - c0, n, false);
+
+		for (auto c = c0; c < c1; c++)
+		{
+			auto xc = &X(0, c);
+
+			for (auto k = 0; k < n; k++)
+			{
+				Xt(c - c0, k) = xc[k];
+			}
+		}
+
+		return Xt;
+	}
+
+	// Tile computed from the dot products: the columns c0:c1 are transposed
+	// into a (c1 - c0) x n block so that the dot products of row r with all the
+	// columns of the tile are computed in contiguous loops (a small matrix
+	// product), after which apply(d, r, w) turns the w dot products d of row r
+	// into kernel values
+	template <typename Apply>
+	void TileProduct(int r0, int r1, int c0, int c1, const Apply& apply)
+	{
+		auto n = Cols();
+		auto w = c1 - c0;
+
+		auto Xt = Columns(c0, c1);
+		auto dist = ManagedArray(w, 1, false);
+
+		for (auto r = r0; r < r1; r++)
+		{
+			auto xr = &X(0, r);
+			auto d = &dist(0);
+
+			for (auto c = 0; c < w; c++)
+			{
+				d[c] = 0.0;
+			}
+
+			for (auto k = 0; k < n; k++)
+			{
+				auto xrk = xr[k];
+				auto xt = &Xt(0, k);
+
+				for (auto c = 0; c < w; c++)
+				{
+					d[c] += xrk * xt[c];
+				}
+			}
+
+			apply(d, r, w);
+
+			// the matrix is symmetric
+			for (auto c = std::max(r, c0); c < c1; c++)
+			{
+				Store(r, c, d[c - c0]);
+			}
+		}
+
+		ManagedOps::Free(Xt);
+		ManagedOps::Free(dist);
+	}
+
+	// Fused RBF tile: exponentials of the squared distances ||xr||^2 + ||xc||^2 - 2 xr.xc
+	void TileRBF(int r0, int r1, int c0, int c1)
+	{
+		TileProduct(r0, r1, c0, c1, [this, c0](double* d, int r, int w)
+		{
+			auto nr = Norms(r);
+			auto nc = &Norms(c0);
+
+			for (auto c = 0; c < w; c++)
+			{
+				d[c] = Distance(nr + nc[c] - 2 * d[c]);
+			}
+		});
+	}
+
+	// Fourier tile: the kernel values of row r with all the (transposed) columns
+	// of the tile are computed together, one feature at a time
+	void TileFourier(int r0, int r1, int c0, int c1)
+	{
+		auto n = Cols();
+		auto w = c1 - c0;
+
+		auto kernel = KernelFunction::FourierKernel(Param);
+
+		auto Xt = Columns(c0, c1);
+		auto values = ManagedArray(w, 1, false);
+		auto work = ManagedArray(w, 2, false);
+
+		for (auto r = r0; r < r1; r++)
+		{
+			kernel.Row(&X(0, r), &Xt(0, 0), w, w, n, &values(0), &work(0));
+
+			// the matrix is symmetric
+			for (auto c = std::max(r, c0); c < c1; c++)
+			{
+				Store(r, c, values(c - c0));
+			}
+		}
+
+		ManagedOps::Free(Xt);
+		ManagedOps::Free(values);
+		ManagedOps::Free(work);
+	}
+
+	// Tile of a kernel of the dot product (Linear, Polynomial, Sigmoid)
+	template <typename Kernel>
+	void TileDot(const Kernel& kernel, int r0, int r1, int c0, int c1)
+	{
+		auto n = Cols();
+
+		TileProduct(r0, r1, c0, c1, [&kernel, n](double* d, int /* r */, int w)
+		{
+			for (auto c = 0; c < w; c++)
+			{
+				d[c] = kernel.FromDot(d[c], n);
+			}
+		});
+	}
+
+public:
+
+	ManagedArray X = NULL;
+	ManagedArray K = NULL;
+	SymmetricMatrix<double> P = SymmetricMatrix<double>();
+	ManagedArray Param = NULL;
+	KernelType Type = KernelType::UNKNOWN;
+
+	// Squared norms ||xi||^2 (RBF kernels only)
+	ManagedArray Norms = NULL;
+
+	// Single precision storage (KS: full, PS: packed) used instead of K and P
+	bool Single = false;
+	std::vector<float> KS;
+	SymmetricMatrix<float> PS = SymmetricMatrix<float>();
+
+	KernelMatrix()
+	{
+
+	}
+
+	int Rows()
+	{
+		return X.y;
+	}
+
+	int Cols()
+	{
+		return X.x;
+	}
+
+	// Returns true if the full kernel matrix has been pre-computed into K (or KS)
+	bool Precomputed()
+	{
+		return Rows() > 0 && (Single ? KS.size() == (size_t)Rows() * Rows() : K.Length() == Rows() * Rows());
+	}
+
+	// Returns true if the kernel matrix has been pre-computed into packed storage P (or PS)
+	bool Packed()
+	{
+		return Rows() > 0 && (Single ? PS.x : P.x) == Rows();
+	}
+
+	// Pointers to column i of the pre-computed kernel matrix
+	double* Dense(int i)
+	{
+		return &K(0, i);
+	}
+
+	float* DenseSingle(int i)
+	{
+		return &KS[(size_t)i * Rows()];
+	}
+
+	// Set precompute to false to skip building K (columns are then computed on demand),
+	// packed to true to only store its upper triangle or single to store it in single precision
+	void Setup(ManagedArray& x, KernelType kernel, ManagedArray& param, bool precompute = true, int threads = 1, bool packed = false, bool single = false)
+	{
+		Free();
+
+		X = ManagedArray(x.x, x.y);
+		Param = ManagedArray(param.Length());
+
+		ManagedOps::Copy2D(X, x, 0, 0);
+		ManagedOps::Copy2D(Param, param, 0, 0);
+
+		Type = kernel;
+		Single = single;
+
+		slope = Param.Length() > 0 ? Param(0) : 1;
+		inter = Param.Length() > 1 ? Param(1) : 0;
+
+		double sigma = Param.Length() > 0 ? Param(0) : 1;
+
+		gamma = KernelFunction::Gamma(sigma);
+
+		if (RBF())
+		{
+			Norms = ManagedArray(1, Rows(), false);
+
+			for (auto i = 0; i < Rows(); i++)
+			{
+				auto xi = &X(0, i);
+
+				auto norm = 0.0;
+
+				for (auto k = 0; k < Cols(); k++)
+				{
+					norm += xi[k] * xi[k];
+				}
+
+				Norms(i) = norm;
+			}
+		}
+
+		if (!precompute)
+			return;
+
+		// Data parameters
+		auto m = Rows();
+
+		// Pre-compute the Kernel Matrix since our dataset is small
+		// (In practice, optimized SVM packages that handle large datasets
+		// gracefully will *not* do this)
+		//
+		// Only the tiles on or above the diagonal are computed (in parallel)
+		// and each one is mirrored into the lower triangle
+		if (packed)
+		{
+			if (single)
+				PS.Resize(m, false);
+			else
+				P.Resize(m, false);
+		}
+		else
+		{
+			if (single)
+				KS.resize((size_t)m * m);
+			else
+				K = ManagedArray(m, m, false);
+		}
+
+		auto blocks = (m + TILE - 1) / TILE;
+
+		auto pool = ThreadPool(threads);
+
+		for (auto bi = 0; bi < blocks; bi++)
+		{
+			for (auto bj = bi; bj < blocks; bj++)
+			{
+				auto r0 = bi * TILE;
+				auto r1 = std::min(m, r0 + TILE);
+				auto c0 = bj * TILE;
+				auto c1 = std::min(m, c0 + TILE);
+
+				pool.Submit([this, r0, r1, c0, c1]()
+				{
+					Tile(r0, r1, c0, c1);
+				});
+			}
+		}
+
+		pool.Run();
+	}
+
+	// Evaluate K(i, j) directly on the rows of X
+	double Evaluate(int i, int j)
+	{
+		auto n = Cols();
+
+		if (Type == KernelType::LINEAR)
+			return slope * KernelFunction::Dot(&X(0, i), &X(0, j), n) + inter;
+
+		if (RBF())
+			return Distance(Norms(i) + Norms(j) - 2 * KernelFunction::Dot(&X(0, i), &X(0, j), n));
+
+		return KernelFunction::Run(Type, &X(0, i), &X(0, j), n, Param);
+	}
+
+	// Compute (or unpack) column i of the kernel matrix into dst
+	template <typename T>
+	void Column(int i, T* dst)
+	{
+		if (Packed())
+		{
+			if (Single)
+				PS.Column(i, dst);
+			else
+				P.Column(i, dst);
+
+			return;
+		}
+
+		switch (Type)
+		{
+		case KernelType::POLYNOMIAL:
+			Column(KernelFunction::PolynomialKernel(Param), i, dst);
+			break;
+		case KernelType::SIGMOID:
+			Column(KernelFunction::SigmoidKernel(Param), i, dst);
+			break;
+		case KernelType::FOURIER:
+			Column(KernelFunction::FourierKernel(Param), i, dst);
+			break;
+		default:
+			for (auto j = 0; j < Rows(); j++)
+			{
+				dst[j] = (T)Evaluate(i, j);
+			}
+		}
+	}
+
+	// Compute the diagonal of the kernel matrix into dst
+	void Diagonal(double* dst)
+	{
+		auto m = Rows();
+
+		if (Precomputed() || Packed())
+		{
+			for (auto i = 0; i < m; i++)
+			{
+				if (Single)
+					dst[i] = Packed() ? PS(i, i) : KS[(size_t)i * m + i];
+				else
+					dst[i] = Packed() ? P(i, i) : K(i, i);
+			}
+
+			return;
+		}
+
+		for (auto i = 0; i < m; i++)
+		{
+			dst[i] = Evaluate(i, i);
+		}
+	}
+
+	void Free()
+	{
+		ManagedOps::Free(X);
+		ManagedOps::Free(K);
+		ManagedOps::Free(Param);
+		ManagedOps::Free(Norms);
+
+		P.Free();
+		PS.Free();
+
+		KS.clear();
+		KS.shrink_to_fit();
+
+		Single = false;
+		Type = KernelType::UNKNOWN;
+	}
+};
+#endif
@@ -127,12 +127,22 @@ public:
 		return Data[ix];
 	}
 
+	const double& operator()(int ix) const
+	{
+		return Data[ix];
+	}
+
 	// 2D arrays
 	double& operator()(int ix, int iy)
 	{
 		return Data[iy * x + ix];
 	}
 
+	const double& operator()(int ix, int iy) const
+	{
+		return Data[iy * x + ix];
+	}
+
 	// 3D arrays
 	double& operator()(int ix, int iy, int iz)
 	{
@@ -192,7 +202,7 @@ public:
 		Data = _New(x * y * z * i * j, initialize);
 	}
 
-	int Length()
+	int Length() const
 	{
 		return x * y* z* i* j;
 	}
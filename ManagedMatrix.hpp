@@ -4,6 +4,7 @@
 #include <iostream>
 #include <iomanip>
 
+#include "Gemm.hpp"
 #include "ManagedArray.hpp"
 #include "ManagedOps.hpp"
 
@@ -158,71 +159,26 @@ public:
 		return dst;
 	}
 
-	#if !defined (FAST_MATRIX_MULTIPLY)
-
-	// 2D Matrix multiplication - Naive Version
-	static void Multiply(ManagedArray& result, ManagedArray& A, ManagedArray& B)
+	// 2D Matrix multiplication result = op(A) * op(B), op(X) = X' if X is transposed (see Gemm.hpp)
+	static void Multiply(ManagedArray& result, ManagedArray& A, ManagedArray& B, bool transposeA, bool transposeB, int threads = 1)
 	{
-		if (A.x == B.y)
-		{
-			// Naive version
-			result.Resize(B.x, A.y, false);
+		auto rows = transposeA ? A.x : A.y;
+		auto mid = transposeA ? A.y : A.x;
+		auto cols = transposeB ? B.y : B.x;
 
-			for (auto y = 0; y < A.y; y++)
-			{
-				for (auto x = 0; x < B.x; x++)
-				{
-					result(x, y) = 0.0;
+		if (mid == (transposeB ? B.x : B.y))
+		{
+			result.Resize(cols, rows, false);
 
-					for (auto k = 0; k < A.x; k++)
-					{
-						result(x, y) += A(k, y) * B(x, k);
-					}
-				}
-			}
+			Gemm::Multiply(rows, cols, mid, &A(0), A.x, transposeA, &B(0), B.x, transposeB, &result(0), cols, threads);
 		}
 	}
 
-	#else
-
 	// 2D Matrix multiplication
-	// slightly faster (due to memory access pattern) but still naive
-	// see: https://tavianator.com/a-quick-trick-for-faster-naive-matrix-multiplication/
 	static void Multiply(ManagedArray& result, ManagedArray& A, ManagedArray& B)
 	{
-		if (A.x == B.y)
-		{
-			auto dest = 0;
-			auto lhs = 0;
-			auto rhs = 0;
-			auto mid = A.x;
-			auto cols = B.x;
-			auto rows = A.y;
-
-			result.Resize(cols, rows, true);
-
-			for (auto y = 0; y < rows; y++)
-			{
-				rhs = 0;
-
-				for (auto x = 0; x < mid; x++)
-				{
-					auto lhsx = lhs + x;
-
-					for (auto k = 0; k < cols; k++)
-					{
-						result(dest + k) += A(lhsx) * B(rhs + k);
-					}
-
-					rhs += cols;
-				}
-
-				dest += cols;
-				lhs += mid;
-			}
-		}
+		Multiply(result, A, B, false, false);
 	}
-	#endif
 
 	// 2D Matrix multiplication
 	static ManagedArray Multiply(ManagedArray& A, ManagedArray& B)
@@ -164,6 +164,18 @@ public:
 		return model;
 	}
 
+	static json RFF(RandomFeatures& map)
+	{
+		json rff;
+
+		rff["Inputs"] = map.Inputs;
+		rff["D"] = map.D;
+		rff["Sigma"] = map.Sigma;
+		rff["Seed"] = map.Seed;
+
+		return rff;
+	}
+
 	static std::string Serialize(std::vector<Model> models)
 	{
 		json j;
@@ -189,6 +201,9 @@ public:
 			m["MaxIterations"] = model.MaxIterations;
 			m["Trained"] = model.Trained;
 
+			if (model.Map.Active())
+				m["RFF"] = RFF(model.Map);
+
 			j["Models"] += m;
 		}
 
@@ -221,6 +236,9 @@ public:
 		m["MaxIterations"] = model.MaxIterations;
 		m["Trained"] = model.Trained;
 
+		if (model.Map.Active())
+			m["RFF"] = RFF(model.Map);
+
 		j["Models"] += m;
 
 		if (model.Min.size() > 0 && model.Max.size() > 0)
@@ -271,6 +289,14 @@ public:
 					model.Min = Vector1D(j, "Normalization", 0);
 					model.Max = Vector1D(j, "Normalization", 1);
 
+					// random Fourier feature mapping (regenerated from its seed)
+					if (m.count("RFF") > 0)
+					{
+						auto rff = m["RFF"];
+
+						model.Map.Setup((int)rff["Inputs"], (int)rff["D"], (double)rff["Sigma"], (int)rff["Seed"]);
+					}
+
 					models.push_back(model);
 				}
 			}
@@ -2,28 +2,984 @@
 #define MODEL_HPP
 
 #include <algorithm>
+#include <climits>
 #include <cmath>
+#include <limits>
 #include <vector>
 
+#include "FastGaussTransform.hpp"
+#include "KernelCache.hpp"
 #include "KernelFunction.hpp"
+#include "KernelMatrix.hpp"
 #include "Random.hpp"
+#include "RandomFeatures.hpp"
+#include "SolverTypes.hpp"
+#include "ThreadPool.hpp"
 
 class Model
 {
 private:
 
 	// Internal variables
-	ManagedArray K = NULL;
+	KernelMatrix* gram = NULL;
 	ManagedArray E = NULL;
 	ManagedArray alpha = NULL;
-	ManagedArray dx = NULL;
 	ManagedArray dy = NULL;
-	ManagedArray kparam = NULL;
 	double b = 0.0;
 	double eta = 0.0;
 	double H = 0.0;
 	double L = 0.0;
-	KernelType ktype = KernelType::UNKNOWN;
+	bool shared = false;
+	bool converged = false;
+
+	// WSS2 solver: active set, shrinking counter and Ebar (see Unshrink)
+	std::vector<int> active;
+	ManagedArray Ebar = NULL;
+	int counter = 0;
+	bool unshrunk = false;
+
+	// accuracy FGT was built for
+	double transform = 0.0;
+
+	// packed kernel matrix: the pair of columns unpacked by UpdateErrors
+	std::vector<double> unpacked;
+
+	// RBF kernels: K(x, sv) = exp(-gamma * d) (see Prepare)
+	double gamma = 0.0;
+
+	void Initialize(ManagedArray& y, double c, double tolerance, int maxpasses, int category)
+	{
+		ManagedOps::Free(dy);
+
+		dy = ManagedArray(y.x, y.y);
+
+		ManagedOps::Copy2D(dy, y, 0, 0);
+
+		// Data parameters
+		auto m = gram->Rows();
+
+		Category = category;
+		MaxIterations = maxpasses;
+		Tolerance = tolerance;
+		C = c;
+
+		// Reset internal variables
+		ManagedOps::Free(E);
+		ManagedOps::Free(alpha);
+
+		// Variables
+		alpha = ManagedArray(1, m);
+		E = ManagedArray(1, m);
+		b = 0.0;
+		Iterations = 0;
+		converged = false;
+
+		ManagedOps::Free(Ebar);
+
+		Ebar = ManagedArray(1, m);
+
+		active.resize(m);
+
+		for (auto i = 0; i < m; i++)
+		{
+			active[i] = i;
+		}
+
+		counter = std::min(m, 1000);
+		unshrunk = false;
+		Shrinks = 0;
+		Unshrinks = 0;
+
+		eta = 0.0;
+		L = 0.0;
+		H = 0.0;
+
+		// Map 0 (or other categories) to -1
+		for (auto i = 0; i < Rows(dy); i++)
+		{
+			dy(i) = (int)dy(i) != Category ? -1 : 1;
+		}
+
+		// Ei = f(x(i)) - y(i) with all alphas and b set to zero
+		for (auto i = 0; i < m; i++)
+		{
+			E(i) = -dy(i);
+		}
+
+		random.UniformDistribution();
+	}
+
+	// Update the error cache after alpha(i), alpha(j) and b have changed:
+	// E(k) += dy(i) * dalpha(i) * K(k, i) + dy(j) * dalpha(j) * K(k, j) + db
+	template <typename T>
+	void UpdateErrors(T Ki, T Kj, double di, double dj, double db)
+	{
+		auto m = Rows(E);
+
+		for (auto k = 0; k < m; k++)
+		{
+			E(k) += di * Ki[k] + dj * Kj[k] + db;
+		}
+	}
+
+	// Columns of a packed kernel matrix are unpacked once (walking their strided
+	// part with a running offset) so that the update is a contiguous loop
+	template <typename T>
+	void UpdatePacked(const T& Ki, const T& Kj, double di, double dj, double db)
+	{
+		auto m = Rows(E);
+
+		unpacked.resize(2 * (size_t)m);
+
+		Ki.Unpack(&unpacked[0]);
+		Kj.Unpack(&unpacked[m]);
+
+		UpdateErrors(&unpacked[0], &unpacked[m], di, dj, db);
+	}
+
+	void UpdateErrors(PackedColumn Ki, PackedColumn Kj, double di, double dj, double db)
+	{
+		UpdatePacked(Ki, Kj, di, dj, db);
+	}
+
+	void UpdateErrors(PackedColumnSingle Ki, PackedColumnSingle Kj, double di, double dj, double db)
+	{
+		UpdatePacked(Ki, Kj, di, dj, db);
+	}
+
+	// Select the working set (i, j) among the active examples using second
+	// order information. Returns true if the KKT conditions are satisfied
+	// within tolerance (i.e. there is no working set left to optimize).
+	template <typename T>
+	bool SelectWorkingSet(int& i, int& j)
+	{
+		const double TAU = 1e-12;
+
+		// Select i from I_up = { t | y(t) = +1, alpha(t) < C or y(t) = -1, alpha(t) > 0 }
+		// maximizing -y(t) * G(t)
+		auto Gmax = -std::numeric_limits<double>::infinity();
+		auto Gmax2 = -std::numeric_limits<double>::infinity();
+
+		i = -1;
+		j = -1;
+
+		for (auto a = 0; a < (int)active.size(); a++)
+		{
+			auto t = active[a];
+
+			if ((dy(t) > 0 && alpha(t) < C) || (dy(t) < 0 && alpha(t) > 0))
+			{
+				if (-E(t) >= Gmax)
+				{
+					Gmax = -E(t);
+					i = t;
+				}
+			}
+		}
+
+		// Select j from I_low = { t | y(t) = +1, alpha(t) > 0 or y(t) = -1, alpha(t) < C }
+		// minimizing the second order approximation of the decrease in the objective
+		auto obj_min = std::numeric_limits<double>::infinity();
+
+		auto Ki = i >= 0 ? Cache.Column<T>(i) : T();
+
+		for (auto a = 0; a < (int)active.size(); a++)
+		{
+			auto t = active[a];
+
+			if ((dy(t) > 0 && alpha(t) > 0) || (dy(t) < 0 && alpha(t) < C))
+			{
+				Gmax2 = std::max(Gmax2, E(t));
+
+				auto grad_diff = Gmax + E(t);
+
+				if (grad_diff > 0)
+				{
+					auto quad_coef = Cache.Diagonal(i) + Cache.Diagonal(t) - 2 * Ki[t];
+
+					auto obj_diff = -(grad_diff * grad_diff) / (quad_coef > 0 ? quad_coef : TAU);
+
+					if (obj_diff <= obj_min)
+					{
+						obj_min = obj_diff;
+						j = t;
+					}
+				}
+			}
+		}
+
+		// Stop when the maximal KKT violation is within tolerance
+		return Gmax + Gmax2 < Tolerance || j < 0;
+	}
+
+	// Returns true if example t is stuck at a bound and can be removed from the active set
+	bool Shrinkable(int t, double Gmax1, double Gmax2)
+	{
+		if (alpha(t) >= C)
+		{
+			return dy(t) > 0 ? -E(t) > Gmax1 : E(t) > Gmax2;
+		}
+		else if (alpha(t) <= 0)
+		{
+			return dy(t) > 0 ? E(t) > Gmax2 : -E(t) > Gmax1;
+		}
+
+		return false;
+	}
+
+	// Remove examples stuck at a bound from the active set (LIBSVM-style shrinking)
+	template <typename T>
+	void Shrink()
+	{
+		// Maximal violations over the active set
+		auto Gmax1 = -std::numeric_limits<double>::infinity();
+		auto Gmax2 = -std::numeric_limits<double>::infinity();
+
+		for (auto a = 0; a < (int)active.size(); a++)
+		{
+			auto t = active[a];
+
+			if ((dy(t) > 0 && alpha(t) < C) || (dy(t) < 0 && alpha(t) > 0))
+				Gmax1 = std::max(Gmax1, -E(t));
+
+			if ((dy(t) > 0 && alpha(t) > 0) || (dy(t) < 0 && alpha(t) < C))
+				Gmax2 = std::max(Gmax2, E(t));
+		}
+
+		// Close to convergence: restore all examples once before shrinking again
+		if (!unshrunk && Gmax1 + Gmax2 <= Tolerance * 10)
+		{
+			unshrunk = true;
+
+			Unshrink<T>();
+		}
+
+		auto size = 0;
+
+		for (auto a = 0; a < (int)active.size(); a++)
+		{
+			auto t = active[a];
+
+			if (Shrinkable(t, Gmax1, Gmax2))
+			{
+				Shrinks++;
+			}
+			else
+			{
+				active[size++] = t;
+			}
+		}
+
+		active.resize(size);
+	}
+
+	// Reconstruct the errors of the inactive examples and restore the full active set
+	//
+	// E(t) = Ebar(t) + sum(alpha(k) * y(k) * K(t, k), free k) - y(t) where
+	// Ebar(t) = C * sum(y(k) * K(t, k), alpha(k) = C) is maintained during training
+	template <typename T>
+	void Unshrink()
+	{
+		auto m = Rows(dy);
+
+		if ((int)active.size() == m)
+			return;
+
+		auto inactive = std::vector<bool>(m, true);
+
+		for (auto a = 0; a < (int)active.size(); a++)
+		{
+			inactive[active[a]] = false;
+		}
+
+		for (auto t = 0; t < m; t++)
+		{
+			if (inactive[t])
+				E(t) = Ebar(t) - dy(t);
+		}
+
+		// only the active set can contain free examples
+		for (auto a = 0; a < (int)active.size(); a++)
+		{
+			auto k = active[a];
+
+			if (alpha(k) > 0 && alpha(k) < C)
+			{
+				auto Kk = Cache.Column<T>(k);
+
+				for (auto t = 0; t < m; t++)
+				{
+					if (inactive[t])
+						E(t) += alpha(k) * dy(k) * Kk[t];
+				}
+			}
+		}
+
+		active.resize(m);
+
+		for (auto t = 0; t < m; t++)
+		{
+			active[t] = t;
+		}
+
+		Unshrinks++;
+	}
+
+	// Simplified SMO solver (T is the type of the kernel matrix columns, see KernelCache::Column)
+	template <typename T>
+	bool StepSMO()
+	{
+		if (Iterations >= MaxIterations)
+			return true;
+
+		// Data parameters
+		auto m = Rows(dy);
+
+		auto num_changed_alphas = 0;
+
+		for (auto i = 0; i < m; i++)
+		{
+			// Ei = f(x(i)) - y(i) is kept up to date by UpdateErrors
+			if ((dy(i) * E(i) < -Tolerance && alpha(i) < C) || (dy(i) * E(i) > Tolerance && alpha(i) > 0))
+			{
+				// In practice, there are many heuristics one can use to select
+				// the i and j. In this simplified code, we select them randomly.
+				auto j = i;
+
+				while (j == i)
+				{
+					// Make sure i != j
+					j = (int)std::floor(m * random.NextDouble());
+				}
+
+				// Save old alphas
+				auto alpha_i_old = alpha(i);
+				auto alpha_j_old = alpha(j);
+
+				// Compute L and H by (10) or (11).
+				if ((int)dy(i) == (int)dy(j))
+				{
+					L = std::max(0.0, alpha(j) + alpha(i) - C);
+					H = std::min(C, alpha(j) + alpha(i));
+				}
+				else
+				{
+					L = std::max(0.0, alpha(j) - alpha(i));
+					H = std::min(C, C + alpha(j) - alpha(i));
+				}
+
+				if (std::abs(L - H) <= std::numeric_limits<double>::epsilon())
+				{
+					// continue to next i
+					continue;
+				}
+
+				// Kernel columns K(:, i) and K(:, j)
+				auto Ki = Cache.Column<T>(i);
+				auto Kj = Cache.Column<T>(j);
+
+				// Compute eta by (14).
+				eta = 2 * Ki[j] - Ki[i] - Kj[j];
+
+				if (eta >= 0)
+				{
+					// continue to next i.
+					continue;
+				}
+
+				// Compute and clip value for alpha j using (12) and (15).
+				alpha(j) = alpha(j) - (dy(j) * (E(i) - E(j))) / eta;
+
+				// Clip
+				alpha(j) = std::min(H, alpha(j));
+				alpha(j) = std::max(L, alpha(j));
+
+				// Check if change in alpha is significant
+				if (std::abs(alpha(j) - alpha_j_old) < Tolerance)
+				{
+					// continue to next i.
+					// replace anyway
+					alpha(j) = alpha_j_old;
+
+					continue;
+				}
+
+				// Determine value for alpha i using (16).
+				alpha(i) = alpha(i) + dy(i) * dy(j) * (alpha_j_old - alpha(j));
+
+				auto b_old = b;
+
+				// Compute b1 and b2 using (17) and (18) respectively.
+				auto b1 = b - E(i) - dy(i) * (alpha(i) - alpha_i_old) * Ki[j] - dy(j) * (alpha(j) - alpha_j_old) * Ki[j];
+				auto b2 = b - E(j) - dy(i) * (alpha(i) - alpha_i_old) * Ki[j] - dy(j) * (alpha(j) - alpha_j_old) * Kj[j];
+
+				// Compute b by (19).
+				if (0 < alpha(i) && alpha(i) < C)
+				{
+					b = b1;
+				}
+				else if (0 < alpha(j) && alpha(j) < C)
+				{
+					b = b2;
+				}
+				else
+				{
+					b = (b1 + b2) / 2;
+				}
+
+				UpdateErrors(Ki, Kj, dy(i) * (alpha(i) - alpha_i_old), dy(j) * (alpha(j) - alpha_j_old), b - b_old);
+
+				num_changed_alphas++;
+			}
+		}
+
+		if (num_changed_alphas == 0)
+		{
+			Iterations++;
+		}
+		else
+		{
+			Iterations = 0;
+		}
+
+		return Iterations >= MaxIterations;
+	}
+
+	// Pre-compute Coef = Alpha * ModelY, the squared norms of the support vectors and gamma
+	void Prepare()
+	{
+		ManagedOps::Free(Coef);
+		ManagedOps::Free(Norms);
+
+		auto sigma = KernelParam.Length() > 0 ? KernelParam(0) : 1;
+
+		gamma = KernelFunction::Gamma(sigma);
+
+		auto nsv = Rows(ModelX);
+
+		Coef = ManagedArray(1, nsv, false);
+		Norms = ManagedArray(1, nsv, false);
+
+		for (auto j = 0; j < nsv; j++)
+		{
+			Coef(j) = Alpha(j) * ModelY(j);
+			Norms(j) = KernelFunction::Dot(&ModelX(0, j), &ModelX(0, j), Cols(ModelX));
+		}
+
+		Order.resize(nsv);
+
+		for (auto j = 0; j < nsv; j++)
+		{
+			Order[j] = j;
+		}
+
+		auto& coef = Coef;
+
+		std::stable_sort(Order.begin(), Order.end(), [&coef](int a, int b) { return std::abs(coef(a)) > std::abs(coef(b)); });
+
+		Upper.assign(nsv + 1, 0.0);
+		Lower.assign(nsv + 1, 0.0);
+
+		for (auto j = nsv - 1; j >= 0; j--)
+		{
+			auto c = Coef(Order[j]);
+
+			Upper[j] = Upper[j + 1] + (c > 0 ? c : 0);
+			Lower[j] = Lower[j + 1] + (c < 0 ? c : 0);
+		}
+	}
+
+	// RBF kernel value from the squared distance d (see KernelFunction::RBF)
+	double RBF(double d) const
+	{
+		return KernelFunction::RBF(Type, gamma, d);
+	}
+
+	// Gaussian decision values using the Fast Gauss Transform (built on first use).
+	// Falls back to PredictRBF if the transform would not be faster than the direct sum.
+	void PredictFGT(ManagedArray& x, ManagedArray& predictions)
+	{
+		const int BLOCK = 256;
+
+		if (transform != Accuracy)
+		{
+			FGT.Setup(ModelX, Coef, KernelParam.Length() > 0 ? KernelParam(0) : 1, Accuracy);
+
+			transform = Accuracy;
+		}
+
+		if (!FGT.Faster())
+		{
+			PredictRBF(x, predictions);
+
+			return;
+		}
+
+		auto m = Rows(x);
+
+		auto pool = ThreadPool(Threads);
+
+		for (auto r0 = 0; r0 < m; r0 += BLOCK)
+		{
+			auto r1 = std::min(m, r0 + BLOCK);
+
+			pool.Submit([this, &x, &predictions, r0, r1]()
+			{
+				auto work = std::vector<double>(Cols(x) + FGT.Terms());
+
+				for (auto r = r0; r < r1; r++)
+				{
+					predictions(r) = FGT.Evaluate(&x(0, r), work.data()) + B;
+				}
+			});
+		}
+
+		pool.Run();
+	}
+
+	// Streaming decision values: predictions(i) = sum(Coef(j) * K(x(i), sv(j))) + B
+	//
+	// Rows are processed in blocks of BLOCK rows against tiles of TILE support
+	// vectors. The support vectors are transposed so that the dot products of
+	// each row with a tile are contiguous loops (a small matrix product), after
+	// which apply(d, w, nr, s0) turns the w dot products d with the support
+	// vectors s0.. into kernel values (nr = ||x(i)||^2). Memory use is bounded
+	// by the tile size instead of the number of rows x support vectors.
+	template <typename Apply>
+	void PredictProduct(ManagedArray& x, ManagedArray& predictions, const Apply& apply)
+	{
+		const int BLOCK = 64;
+		const int TILE = 256;
+
+		auto m = Rows(x);
+		auto n = Cols(x);
+		auto nsv = Rows(ModelX);
+
+		auto svt = ManagedArray(nsv, n, false);
+
+		for (auto j = 0; j < nsv; j++)
+		{
+			for (auto k = 0; k < n; k++)
+			{
+				svt(j, k) = ModelX(k, j);
+			}
+		}
+
+		auto dist = ManagedArray(TILE, 1, false);
+
+		for (auto r0 = 0; r0 < m; r0 += BLOCK)
+		{
+			auto r1 = std::min(m, r0 + BLOCK);
+
+			for (auto r = r0; r < r1; r++)
+			{
+				predictions(r) = B;
+			}
+
+			for (auto s0 = 0; s0 < nsv; s0 += TILE)
+			{
+				auto w = std::min(nsv, s0 + TILE) - s0;
+
+				for (auto r = r0; r < r1; r++)
+				{
+					auto xr = &x(0, r);
+					auto d = &dist(0);
+
+					auto nr = 0.0;
+
+					for (auto c = 0; c < w; c++)
+					{
+						d[c] = 0.0;
+					}
+
+					for (auto k = 0; k < n; k++)
+					{
+						auto xrk = xr[k];
+						auto sv = &svt(s0, k);
+
+						nr += xrk * xrk;
+
+						for (auto c = 0; c < w; c++)
+						{
+							d[c] += xrk * sv[c];
+						}
+					}
+
+					apply(d, w, nr, s0);
+
+					auto cs = &Coef(s0);
+
+					auto sum = 0.0;
+
+					for (auto c = 0; c < w; c++)
+					{
+						sum += cs[c] * d[c];
+					}
+
+					predictions(r) += sum;
+				}
+			}
+		}
+
+		ManagedOps::Free(svt);
+		ManagedOps::Free(dist);
+	}
+
+	// RBF kernels: exponentials of the squared distances ||x||^2 + ||sv||^2 - 2 x.sv
+	// (the squared norms of the support vectors are computed once, see Prepare)
+	void PredictRBF(ManagedArray& x, ManagedArray& predictions)
+	{
+		PredictProduct(x, predictions, [this](double* d, int w, double nr, int s0)
+		{
+			auto ns = &Norms(s0);
+
+			for (auto c = 0; c < w; c++)
+			{
+				d[c] = RBF(nr + ns[c] - 2 * d[c]);
+			}
+		});
+	}
+
+	// Kernels of the dot product (Polynomial, Sigmoid)
+	template <typename Kernel>
+	void PredictDot(const Kernel& kernel, ManagedArray& x, ManagedArray& predictions)
+	{
+		auto n = Cols(x);
+
+		PredictProduct(x, predictions, [&kernel, n](double* d, int w, double /* nr */, int /* s0 */)
+		{
+			for (auto c = 0; c < w; c++)
+			{
+				d[c] = kernel.FromDot(d[c], n);
+			}
+		});
+	}
+
+	// Fourier kernel: the kernel values of each row with a tile of the (transposed)
+	// support vectors are computed together, one feature at a time
+	void PredictFourier(ManagedArray& x, ManagedArray& predictions)
+	{
+		const int TILE = 256;
+
+		auto m = Rows(x);
+		auto n = Cols(x);
+		auto nsv = Rows(ModelX);
+
+		auto kernel = KernelFunction::FourierKernel(KernelParam);
+
+		auto svt = ManagedArray(nsv, n, false);
+
+		for (auto j = 0; j < nsv; j++)
+		{
+			for (auto k = 0; k < n; k++)
+			{
+				svt(j, k) = ModelX(k, j);
+			}
+		}
+
+		auto values = ManagedArray(TILE, 1, false);
+		auto work = ManagedArray(TILE, 2, false);
+
+		for (auto r = 0; r < m; r++)
+		{
+			predictions(r) = B;
+		}
+
+		for (auto s0 = 0; s0 < nsv; s0 += TILE)
+		{
+			auto w = std::min(nsv, s0 + TILE) - s0;
+			auto cs = &Coef(s0);
+
+			for (auto r = 0; r < m; r++)
+			{
+				auto d = &values(0);
+
+				kernel.Row(&x(0, r), &svt(s0, 0), nsv, w, n, d, &work(0));
+
+				auto sum = 0.0;
+
+				for (auto c = 0; c < w; c++)
+				{
+					sum += cs[c] * d[c];
+				}
+
+				predictions(r) += sum;
+			}
+		}
+
+		ManagedOps::Free(svt);
+		ManagedOps::Free(values);
+		ManagedOps::Free(work);
+	}
+
+	// Second-order working set selection (WSS2) SMO solver
+	//
+	// Performs up to m iterations per call over the maintained error vector.
+	// With b held at zero during optimization, the dual gradient is
+	// G(t) = y(t) * E(t) so that -y(t) * G(t) = -E(t).
+	//
+	// See: R.E. Fan, P.H. Chen, and C.J. Lin, "Working set selection using
+	// second order information for training support vector machines".
+	// Journal of Machine Learning Research, 2005. 6: p. 1889-1918.
+	template <typename T>
+	bool StepWSS2()
+	{
+		if (converged)
+			return true;
+
+		// Data parameters
+		auto m = Rows(dy);
+
+		// same safeguard as LIBSVM
+		auto limit = std::max(10000000, m > INT_MAX / 100 ? INT_MAX : 100 * m);
+
+		for (auto iter = 0; iter < m; iter++)
+		{
+			if (Shrinking && --counter == 0)
+			{
+				counter = std::min(m, 1000);
+
+				Shrink<T>();
+			}
+
+			auto i = -1;
+			auto j = -1;
+
+			if (SelectWorkingSet<T>(i, j))
+			{
+				// Verify optimality on the whole training set before stopping
+				Unshrink<T>();
+
+				if (SelectWorkingSet<T>(i, j))
+				{
+					converged = true;
+
+					break;
+				}
+
+				counter = 1;
+			}
+
+			auto Ki = Cache.Column<T>(i);
+			auto Kj = Cache.Column<T>(j);
+
+			// Save old alphas
+			auto alpha_i_old = alpha(i);
+			auto alpha_j_old = alpha(j);
+
+			auto quad_coef = Ki[i] + Kj[j] - 2 * Ki[j];
+
+			if (quad_coef <= 0)
+				quad_coef = 1e-12;
+
+			// Solve the two-variable sub-problem and clip to the box [0, C]
+			if ((int)dy(i) != (int)dy(j))
+			{
+				auto delta = (-dy(i) * E(i) - dy(j) * E(j)) / quad_coef;
+				auto diff = alpha(i) - alpha(j);
+
+				alpha(i) += delta;
+				alpha(j) += delta;
+
+				if (diff > 0)
+				{
+					if (alpha(j) < 0)
+					{
+						alpha(j) = 0;
+						alpha(i) = diff;
+					}
+				}
+				else
+				{
+					if (alpha(i) < 0)
+					{
+						alpha(i) = 0;
+						alpha(j) = -diff;
+					}
+				}
+
+				if (diff > 0)
+				{
+					if (alpha(i) > C)
+					{
+						alpha(i) = C;
+						alpha(j) = C - diff;
+					}
+				}
+				else
+				{
+					if (alpha(j) > C)
+					{
+						alpha(j) = C;
+						alpha(i) = C + diff;
+					}
+				}
+			}
+			else
+			{
+				auto delta = (dy(i) * E(i) - dy(j) * E(j)) / quad_coef;
+				auto sum = alpha(i) + alpha(j);
+
+				alpha(i) -= delta;
+				alpha(j) += delta;
+
+				if (sum > C)
+				{
+					if (alpha(i) > C)
+					{
+						alpha(i) = C;
+						alpha(j) = sum - C;
+					}
+				}
+				else
+				{
+					if (alpha(j) < 0)
+					{
+						alpha(j) = 0;
+						alpha(i) = sum;
+					}
+				}
+
+				if (sum > C)
+				{
+					if (alpha(j) > C)
+					{
+						alpha(j) = C;
+						alpha(i) = sum - C;
+					}
+				}
+				else
+				{
+					if (alpha(i) < 0)
+					{
+						alpha(i) = 0;
+						alpha(j) = sum;
+					}
+				}
+			}
+
+			auto di = dy(i) * (alpha(i) - alpha_i_old);
+			auto dj = dy(j) * (alpha(j) - alpha_j_old);
+
+			// Update the errors of the active examples
+			for (auto a = 0; a < (int)active.size(); a++)
+			{
+				auto t = active[a];
+
+				E(t) += di * Ki[t] + dj * Kj[t];
+			}
+
+			// Update Ebar if alpha(i) or alpha(j) moved to or from the upper bound
+			if (Shrinking)
+			{
+				UpdateBounded(i, alpha_i_old, Ki);
+				UpdateBounded(j, alpha_j_old, Kj);
+			}
+
+			Iterations++;
+
+			if (Iterations >= limit)
+			{
+				Unshrink<T>();
+
+				converged = true;
+
+				break;
+			}
+		}
+
+		if (converged)
+		{
+			b = Bias();
+		}
+
+		return converged;
+	}
+
+	template <typename T>
+	void UpdateBounded(int k, double alpha_old, T Kk)
+	{
+		auto was_bounded = alpha_old >= C;
+		auto is_bounded = alpha(k) >= C;
+
+		if (was_bounded != is_bounded)
+		{
+			auto m = Rows(dy);
+			auto scale = (is_bounded ? C : -C) * dy(k);
+
+			for (auto t = 0; t < m; t++)
+			{
+				Ebar(t) += scale * Kk[t];
+			}
+		}
+	}
+
+	// b = -rho, where rho is the average of y(t) * G(t) over the free support
+	// vectors (or the midpoint of its feasible range if there are none)
+	double Bias()
+	{
+		auto m = Rows(dy);
+
+		auto ub = std::numeric_limits<double>::infinity();
+		auto lb = -std::numeric_limits<double>::infinity();
+		auto sum = 0.0;
+		auto nfree = 0;
+
+		for (auto t = 0; t < m; t++)
+		{
+			auto yG = E(t);
+
+			if (alpha(t) >= C)
+			{
+				if (dy(t) < 0)
+					ub = std::min(ub, yG);
+				else
+					lb = std::max(lb, yG);
+			}
+			else if (alpha(t) <= 0)
+			{
+				if (dy(t) > 0)
+					ub = std::min(ub, yG);
+				else
+					lb = std::max(lb, yG);
+			}
+			else
+			{
+				nfree++;
+				sum += yG;
+			}
+		}
+
+		auto rho = nfree > 0 ? sum / nfree : (ub + lb) / 2;
+
+		return -rho;
+	}
+
+	// One call of the selected solver
+	template <typename T>
+	bool Solve()
+	{
+		return Solver == SolverType::WSS2 ? StepWSS2<T>() : StepSMO<T>();
+	}
+
+	// Release the kernel matrix (only if it is not shared with other models)
+	void Release()
+	{
+		Cache.Free();
+
+		unpacked.clear();
+		unpacked.shrink_to_fit();
+
+		if (gram != NULL && !shared)
+		{
+			gram->Free();
+
+			delete gram;
+		}
+
+		gram = NULL;
+		shared = false;
+	}
 
 public:
 
@@ -42,6 +998,45 @@ public:
 	int MaxIterations = 5;
 	bool Trained = false;
 
+	// Alpha * ModelY and the squared norms of the support vectors (see Prepare)
+	ManagedArray Coef = NULL;
+	ManagedArray Norms = NULL;
+
+	// Support vectors ordered by decreasing |Coef| and the sums of the positive
+	// (Upper) and negative (Lower) coefficients from Order[j] onwards
+	std::vector<int> Order;
+	std::vector<double> Upper;
+	std::vector<double> Lower;
+
+	// Linear model trained on random Fourier features of the inputs (if active)
+	RandomFeatures Map = RandomFeatures();
+
+	// Gaussian models: absolute accuracy of the Fast Gauss Transform used by Predict (0 = exact)
+	double Accuracy = 0.0;
+	FastGaussTransform FGT = FastGaussTransform();
+
+	SolverType Solver = SolverType::SMO;
+
+	// WSS2 solver: enable shrinking and number of examples shrunk / full unshrinks
+	bool Shrinking = true;
+	int Shrinks = 0;
+	int Unshrinks = 0;
+
+	// Kernel cache size in MB (0 = pre-compute the full kernel matrix), allocated
+	// on the first Step and released by Generate
+	double CacheSize = 0.0;
+
+	// Number of threads used to pre-compute the kernel matrix (and by the Fast Gauss Transform)
+	int Threads = 1;
+
+	// Store only the upper triangle of the kernel matrix (read in place by the solvers)
+	bool Packed = false;
+
+	// Store the kernel matrix and cached columns in single precision (errors are accumulated in double)
+	bool Single = false;
+
+	KernelCache Cache = KernelCache();
+
 	std::vector<double> Min;
 	std::vector<double> Max;
 
@@ -68,6 +1063,8 @@ public:
 		MaxIterations = passes;
 		Iterations = passes;
 		Trained = true;
+
+		Prepare();
 	}
 
 	int Rows(ManagedArray& x)
@@ -82,135 +1079,25 @@ public:
 
 	void Setup(ManagedArray& x, ManagedArray& y, double c, KernelType kernel, ManagedArray& param, double tolerance = 0.001, int maxpasses = 5, int category = 1)
 	{
-		ManagedOps::Free(dx);
-		ManagedOps::Free(dy);
-
-		dx = ManagedArray(x.x, x.y);
-		dy = ManagedArray(y.x, y.y);
-
-		ManagedOps::Copy2D(dx, x, 0, 0);
-		ManagedOps::Copy2D(dy, y, 0, 0);
-
-		ktype = kernel;
-
-		// Data parameters
-		auto m = Rows(dx);
-
-		Category = category;
-		MaxIterations = maxpasses;
-		Tolerance = tolerance;
-		C = c;
-
-		// Reset internal variables
-		ManagedOps::Free(K);
-		ManagedOps::Free(kparam);
-		ManagedOps::Free(E);
-		ManagedOps::Free(alpha);
-
-		kparam = ManagedArray(param.Length());
-		ManagedOps::Copy2D(kparam, param, 0, 0);
-
-		// Variables
-		alpha = ManagedArray(1, m);
-		E = ManagedArray(1, m);
-		b = 0.0;
-		Iterations = 0;
-
-		// Pre-compute the Kernel Matrix since our dataset is small
-		// (In practice, optimized SVM packages that handle large datasets
-		// gracefully will *not* do this)
-		if (kernel == KernelType::LINEAR)
-		{
-			// Computation for the Linear Kernel
-			// This is equivalent to computing the kernel on every pair of examples
-			auto tinput = ManagedMatrix::Transpose(dx);
-
-			K = ManagedMatrix::Multiply(dx, tinput);
-
-			double slope = kparam.Length() > 0 ? kparam(0) : 1;
-			double inter = kparam.Length() > 1 ? kparam(1) : 0;
-
-			ManagedMatrix::Multiply(K, slope);
-			ManagedMatrix::Add(K, inter);
-
-			ManagedOps::Free(tinput);
-		}
-		else if (kernel == KernelType::GAUSSIAN || kernel == KernelType::RADIAL)
-		{
-			// RBF Kernel
-			// This is equivalent to computing the kernel on every pair of examples
-			auto pX2 = ManagedMatrix::Pow(dx, 2);
-			auto rX2 = ManagedMatrix::RowSums(pX2);
-			auto tX2 = ManagedMatrix::Transpose(rX2);
-			auto trX = ManagedMatrix::Transpose(dx);
-
-			auto tempK = ManagedArray(m, m);
-			auto temp1 = ManagedArray(m, m);
-			auto temp2 = ManagedMatrix::Multiply(dx, trX);
-
-			ManagedMatrix::Expand(rX2, m, 1, tempK);
-			ManagedMatrix::Expand(tX2, 1, m, temp1);
-			ManagedMatrix::Multiply(temp2, -2);
-
-			ManagedMatrix::Add(tempK, temp1);
-			ManagedMatrix::Add(tempK, temp2);
-
-			double sigma = kparam.Length() > 0 ? kparam(0) : 1;
-
-			auto g = std::abs(sigma) > 0 ? std::exp(-1 / (2 * sigma * sigma)) : 0;
-
-			if (Type == KernelType::RADIAL)
-				ManagedMatrix::Sqrt(tempK);
-
-			K = ManagedMatrix::Pow(g, tempK);
-
-			ManagedOps::Free(pX2);
-			ManagedOps::Free(rX2);
-			ManagedOps::Free(tX2);
-			ManagedOps::Free(trX);
-			ManagedOps::Free(tempK);
-			ManagedOps::Free(temp1);
-			ManagedOps::Free(temp2);
-		}
-		else
-		{
-			// Pre-compute the Kernel Matrix
-			// The following can be slow due to the lack of vectorization
-			K = ManagedArray(m, m);
-
-			auto Xi = ManagedArray(Cols(dx), 1);
-			auto Xj = ManagedArray(Cols(dx), 1);
-
-			for (auto i = 0; i < m; i++)
-			{
-				ManagedOps::Copy2D(Xi, dx, 0, i);
+		Release();
 
-				for (auto j = 0; j < m; j++)
-				{
-					ManagedOps::Copy2D(Xj, dx, 0, j);
-
-					K(j, i) = KernelFunction::Run(kernel, Xi, Xj, kparam);
-
-					// the matrix is symmetric
-					K(i, j) = K(j, i);
-				}
-			}
+		// Model owns its kernel matrix
+		gram = new KernelMatrix();
+		gram->Setup(x, kernel, param, CacheSize <= 0 || Packed, Threads, Packed, Single);
+		shared = false;
 
-			ManagedOps::Free(Xi);
-			ManagedOps::Free(Xj);
-		}
+		Initialize(y, c, tolerance, maxpasses, category);
+	}
 
-		eta = 0.0;
-		L = 0.0;
-		H = 0.0;
+	// Setup using a kernel matrix shared with other models trained on the same inputs
+	void Setup(KernelMatrix& kernel, ManagedArray& y, double c, double tolerance = 0.001, int maxpasses = 5, int category = 1)
+	{
+		Release();
 
-		// Map 0 (or other categories) to -1
-		for (auto i = 0; i < Rows(dy); i++)
-		{
-			dy(i) = (int)dy(i) != Category ? -1 : 1;
-		}
+		gram = &kernel;
+		shared = true;
 
-		random.UniformDistribution();
+		Initialize(y, c, tolerance, maxpasses, category);
 	}
 
 	void GetNormalization(ManagedArray& input)
@@ -309,135 +1196,20 @@ public:
 
 	bool Step()
 	{
-		if (Iterations >= MaxIterations)
-			return true;
-
-		// Data parameters
-		auto m = Rows(dy);
-
-		auto num_changed_alphas = 0;
-
-		for (auto i = 0; i < m; i++)
-		{
-			// Calculate Ei = f(x(i)) - y(i) using (2).
-			E(i) = b;
-
-			for (auto yy = 0; yy < m; yy++)
-			{
-				E(i) += alpha(yy) * dy(yy) * K(yy, i);
-			}
-
-			E(i) -= dy(i);
-
-			if ((dy(i) * E(i) < -Tolerance && alpha(i) < C) || (dy(i) * E(i) > Tolerance && alpha(i) > 0))
-			{
-				// In practice, there are many heuristics one can use to select
-				// the i and j. In this simplified code, we select them randomly.
-				auto j = i;
-
-				while (j == i)
-				{
-					// Make sure i != j
-					j = (int)std::floor(m * random.NextDouble());
-				}
-
-				// Calculate Ej = f(x(j)) - y(j) using (2).
-				E(j) = b;
-
-				for (auto yy = 0; yy < m; yy++)
-				{
-					E(j) += alpha(yy) * dy(yy) * K(yy, j);
-				}
-
-				E(j) -= dy(j);
-
-				// Save old alphas
-				auto alpha_i_old = alpha(i);
-				auto alpha_j_old = alpha(j);
-
-				// Compute L and H by (10) or (11).
-				if ((int)dy(i) == (int)dy(j))
-				{
-					L = std::max(0.0, alpha(j) + alpha(i) - C);
-					H = std::min(C, alpha(j) + alpha(i));
-				}
-				else
-				{
-					L = std::max(0.0, alpha(j) - alpha(i));
-					H = std::min(C, C + alpha(j) - alpha(i));
-				}
+		// models set up ahead of training do not hold their cache until they run
+		if (!Cache.Active())
+			Cache.Setup(*gram, CacheSize);
 
-				if (std::abs(L - H) <= std::numeric_limits<double>::epsilon())
-				{
-					// continue to next i
-					continue;
-				}
-
-				// Compute eta by (14).
-				eta = 2 * K(j, i) - K(i, i) - K(j, j);
-
-				if (eta >= 0)
-				{
-					// continue to next i.
-					continue;
-				}
-
-				// Compute and clip value for alpha j using (12) and (15).
-				alpha(j) = alpha(j) - (dy(j) * (E(i) - E(j))) / eta;
-
-				// Clip
-				alpha(j) = std::min(H, alpha(j));
-				alpha(j) = std::max(L, alpha(j));
-
-				// Check if change in alpha is significant
-				if (std::abs(alpha(j) - alpha_j_old) < Tolerance)
-				{
-					// continue to next i.
-					// replace anyway
-					alpha(j) = alpha_j_old;
-
-					continue;
-				}
-
-				// Determine value for alpha i using (16).
-				alpha(i) = alpha(i) + dy(i) * dy(j) * (alpha_j_old - alpha(j));
-
-				// Compute b1 and b2 using (17) and (18) respectively.
-				auto b1 = b - E(i) - dy(i) * (alpha(i) - alpha_i_old) * K(j, i) - dy(j) * (alpha(j) - alpha_j_old) * K(j, i);
-				auto b2 = b - E(j) - dy(i) * (alpha(i) - alpha_i_old) * K(j, i) - dy(j) * (alpha(j) - alpha_j_old) * K(j, j);
-
-				// Compute b by (19).
-				if (0 < alpha(i) && alpha(i) < C)
-				{
-					b = b1;
-				}
-				else if (0 < alpha(j) && alpha(j) < C)
-				{
-					b = b2;
-				}
-				else
-				{
-					b = (b1 + b2) / 2;
-				}
-
-				num_changed_alphas++;
-			}
-		}
-
-		if (num_changed_alphas == 0)
-		{
-			Iterations++;
-		}
-		else
-		{
-			Iterations = 0;
-		}
+		if (Cache.Packed())
+			return Cache.Single() ? Solve<PackedColumnSingle>() : Solve<PackedColumn>();
 
-		return Iterations >= MaxIterations;
+		return Cache.Single() ? Solve<float*>() : Solve<double*>();
 	}
 
 	void Generate()
 	{
+		auto& dx = gram->X;
+
 		auto m = Rows(dx);
 		auto n = Cols(dx);
 
@@ -460,7 +1232,7 @@ public:
 		ModelX = ManagedArray(Cols(dx), idx);
 		ModelY = ManagedArray(1, idx);
 		Alpha = ManagedArray(1, idx);
-		KernelParam = ManagedArray(kparam.Length());
+		KernelParam = ManagedArray(gram->Param.Length());
 
 		auto ii = 0;
 
@@ -483,26 +1255,25 @@ public:
 
 		B = b;
 		Passes = Iterations;
-		ManagedOps::Copy2D(KernelParam, kparam, 0, 0);
-		Type = ktype;
+		ManagedOps::Copy2D(KernelParam, gram->Param, 0, 0);
+		Type = gram->Type;
 
+		// W = X' * (alpha .* y)
 		auto axy = ManagedMatrix::BSXMUL(alpha, dy);
-		auto tay = ManagedMatrix::Transpose(axy);
-		auto txx = ManagedMatrix::Multiply(tay, dx);
 
-		W = ManagedMatrix::Transpose(txx);
+		ManagedMatrix::Multiply(W, dx, axy, true, false, Threads);
 
 		Trained = true;
 
-		ManagedOps::Free(dx);
+		Prepare();
+
+		Release();
+
 		ManagedOps::Free(dy);
-		ManagedOps::Free(K);
-		ManagedOps::Free(kparam);
 		ManagedOps::Free(E);
+		ManagedOps::Free(Ebar);
 		ManagedOps::Free(alpha);
 		ManagedOps::Free(axy);
-		ManagedOps::Free(tay);
-		ManagedOps::Free(txx);
 	}
 
 	// SVMTRAIN Trains an SVM classifier using a simplified version of the SMO
@@ -568,114 +1339,132 @@ public:
 
 			predictions.Resize(1, m);
 
-			if (Type == KernelType::LINEAR)
+			if (Type == KernelType::LINEAR && Map.Active())
+			{
+				Decision(&x(0, 0), m, Cols(x), &predictions(0));
+			}
+			else if (Type == KernelType::LINEAR)
 			{
-				ManagedMatrix::Multiply(predictions, x, W);
+				ManagedMatrix::Multiply(predictions, x, W, false, false, Threads);
 				ManagedMatrix::Add(predictions, B);
 			}
+			else if (Type == KernelType::GAUSSIAN && Accuracy > 0)
+			{
+				PredictFGT(x, predictions);
+			}
 			else if (Type == KernelType::GAUSSIAN || Type == KernelType::RADIAL)
 			{
-				// RBF Kernel
-				// This is equivalent to computing the kernel on every pair of examples
-				auto pX1 = ManagedMatrix::Pow(x, 2);
-				auto pX2 = ManagedMatrix::Pow(ModelX, 2);
-				auto rX2 = ManagedMatrix::RowSums(pX2);
-
-				auto X1 = ManagedMatrix::RowSums(pX1);
-				auto X2 = ManagedMatrix::Transpose(rX2);
-				auto tX = ManagedMatrix::Transpose(ModelX);
-				auto tY = ManagedMatrix::Transpose(ModelY);
-				auto tA = ManagedMatrix::Transpose(Alpha);
-
-				auto rows = Rows(X1);
-				auto cols = Cols(X2);
-
-				auto tempK = ManagedArray(cols, rows);
-				auto temp1 = ManagedArray(cols, rows);
-				auto temp2 = ManagedMatrix::Multiply(x, tX);
-
-				ManagedMatrix::Multiply(temp2, -2);
-
-				ManagedMatrix::Expand(X1, cols, 1, tempK);
-				ManagedMatrix::Expand(X2, 1, rows, temp1);
-
-				ManagedMatrix::Add(tempK, temp1);
-				ManagedMatrix::Add(tempK, temp2);
-
-				auto sigma = KernelParam.Length() > 0 ? KernelParam(0) : 1;
+				PredictRBF(x, predictions);
+			}
+			else if (Type == KernelType::POLYNOMIAL)
+			{
+				PredictDot(KernelFunction::PolynomialKernel(KernelParam), x, predictions);
+			}
+			else if (Type == KernelType::SIGMOID)
+			{
+				PredictDot(KernelFunction::SigmoidKernel(KernelParam), x, predictions);
+			}
+			else if (Type == KernelType::FOURIER)
+			{
+				PredictFourier(x, predictions);
+			}
+			else
+			{
+				Decision(&x(0, 0), m, Cols(x), &predictions(0));
+			}
 
-				if (Type == KernelType::RADIAL)
-					ManagedMatrix::Sqrt(tempK);
+			ManagedOps::Free(x);
+		}
 
-				auto g = std::abs(sigma) > 0 ? std::exp(-1 / (2 * sigma * sigma)) : 0;
+		return predictions;
+	}
 
-				auto Kernel = ManagedMatrix::Pow(g, tempK);
+	// Decision value of a single example x with n features
+	//
+	// Reads the support vectors in place and does not allocate, so it can be
+	// called concurrently from multiple threads on the same (trained) model
+	double Decision(const double* x, int n) const
+	{
+		if (!Trained)
+			return 0.0;
 
-				auto tempY = ManagedArray(Cols(tY), rows);
-				auto tempA = ManagedArray(Cols(tA), rows);
+		if (Type == KernelType::LINEAR)
+			return Map.Active() ? Map.Decision(x, &W(0), B) : KernelFunction::Dot(x, &W(0), n) + B;
 
-				ManagedMatrix::Expand(tY, 1, rows, tempY);
-				ManagedMatrix::Expand(tA, 1, rows, tempA);
+		return KernelFunction::Expansion(Type, x, &ModelX(0, 0), &Coef(0), &Norms(0), ModelX.y, n, B, KernelParam);
+	}
 
-				ManagedMatrix::Product(Kernel, tempY);
-				ManagedMatrix::Product(Kernel, tempA);
+	// Decision values of a batch of rows examples stored row by row (n features each)
+	void Decision(const double* x, int rows, int n, double* decisions) const
+	{
+		if (Type != KernelType::LINEAR)
+		{
+			KernelFunction::Expansion(Type, x, rows, &ModelX(0, 0), &Coef(0), &Norms(0), ModelX.y, n, B, KernelParam, decisions);
 
-				auto p = ManagedMatrix::RowSums(Kernel);
+			return;
+		}
 
-				ManagedOps::Copy2D(predictions, p, 0, 0);
-				ManagedMatrix::Add(predictions, B);
+		for (auto i = 0; i < rows; i++)
+		{
+			decisions[i] = Decision(x + (long long)i * n, n);
+		}
+	}
 
-				ManagedOps::Free(pX1);
-				ManagedOps::Free(pX2);
-				ManagedOps::Free(rX2);
-				ManagedOps::Free(X1);
-				ManagedOps::Free(X2);
-				ManagedOps::Free(tempK);
-				ManagedOps::Free(temp1);
-				ManagedOps::Free(temp2);
-				ManagedOps::Free(tX);
-				ManagedOps::Free(tY);
-				ManagedOps::Free(tA);
-				ManagedOps::Free(tempY);
-				ManagedOps::Free(tempA);
-				ManagedOps::Free(Kernel);
-				ManagedOps::Free(p);
-			}
-			else
-			{
-				auto Xi = ManagedArray(Cols(x), 1);
-				auto Xj = ManagedArray(Cols(ModelX), 1);
+	// Classify a single example x with n features
+	//
+	// For the RBF kernels 0 < K(x, sv) <= 1, so the support vectors that have
+	// not been visited yet can only add between Lower[j] and Upper[j] to the
+	// decision value. Visiting them by decreasing |Coef| lets the sum stop as
+	// soon as it can no longer cross the threshold, with the same label as
+	// Predict. evaluations (if not NULL) receives the number of kernel
+	// evaluations used.
+	int Classify(const double* x, int n, double threshold = 0.0, int* evaluations = NULL) const
+	{
+		auto nsv = ModelX.y;
 
-				for (auto i = 0; i < m; i++)
-				{
-					double prediction = 0.0;
+		if (!Trained || (Type != KernelType::GAUSSIAN && Type != KernelType::RADIAL) || (int)Order.size() != nsv)
+		{
+			if (evaluations != NULL)
+				*evaluations = Type == KernelType::LINEAR ? 0 : nsv;
 
-					ManagedOps::Copy2D(Xi, x, 0, i);
+			return Decision(x, n) > threshold ? Category : 0;
+		}
 
-					for (auto j = 0; j < Rows(ModelX); j++)
-					{
-						ManagedOps::Copy2D(Xj, ModelX, 0, j);
+		auto nx = KernelFunction::Dot(x, x, n);
 
-						prediction += Alpha(j) * ModelY(j) * KernelFunction::Run(Type, Xi, Xj, KernelParam);
-					}
+		auto sum = B;
+		auto j = 0;
 
-					predictions(i) = prediction + B;
-				}
+		for (; j < nsv; j++)
+		{
+			if (sum + Lower[j] > threshold || sum + Upper[j] <= threshold)
+				break;
 
-				ManagedOps::Free(Xi);
-				ManagedOps::Free(Xj);
-			}
+			auto k = Order[j];
 
-			ManagedOps::Free(x);
+			sum += Coef(k) * RBF(nx + Norms(k) - 2 * KernelFunction::Dot(x, &ModelX(0, k), n));
 		}
 
-		return predictions;
+		if (evaluations != NULL)
+			*evaluations = j;
+
+		return sum > threshold ? Category : 0;
 	}
 
 	ManagedIntList Classify(ManagedArray& input, double threshold = 0.0)
 	{
 		auto classification = ManagedIntList(Rows(input));
 
+		if (Trained && (Type == KernelType::GAUSSIAN || Type == KernelType::RADIAL) && Cols(input) == Cols(ModelX))
+		{
+			for (auto i = 0; i < Rows(input); i++)
+			{
+				classification(i) = Classify(&input(0, i), Cols(input), threshold);
+			}
+
+			return classification;
+		}
+
 		auto predictions = Predict(input);
 
 		for (auto i = 0; i < predictions.Length(); i++)
@@ -710,14 +1499,27 @@ public:
 		ManagedOps::Free(Alpha);
 		ManagedOps::Free(W);
 		ManagedOps::Free(KernelParam);
+		ManagedOps::Free(Coef);
+		ManagedOps::Free(Norms);
+
+		Order.clear();
+		Upper.clear();
+		Lower.clear();
+
+		FGT.Free();
+		transform = 0.0;
+
+		Map.Free();
 
 		// internal variables
-		ManagedOps::Free(K);
+		Release();
+
 		ManagedOps::Free(E);
+		ManagedOps::Free(Ebar);
 		ManagedOps::Free(alpha);
-		ManagedOps::Free(kparam);
-		ManagedOps::Free(dx);
 		ManagedOps::Free(dy);
+
+		active.clear();
 	}
 };
 #endif
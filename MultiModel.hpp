@@ -0,0 +1,389 @@
+#ifndef MULTI_MODEL_HPP
+#define MULTI_MODEL_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <vector>
+
+#include "KernelFunction.hpp"
+#include "Model.hpp"
+#include "ThreadPool.hpp"
+
+// Scores a set of one-vs-rest models that share the same kernel
+//
+// Models trained on the same inputs have largely the same support vectors, so
+// the union of their support vectors is stored once together with a matrix of
+// per-model coefficients Coef(k, j) = Alpha(j) * ModelY(j) of model k (zero if
+// j is not one of its support vectors). Every kernel value K(x, sv(j)) is then
+// evaluated once per input and accumulated into the scores of all models.
+//
+// Input rows are scored in blocks of BLOCK rows which can be distributed over
+// a thread pool, each block writing its own columns of the scores.
+class MultiModel
+{
+private:
+
+	// Tile sizes (input rows x support vectors)
+	static const int BLOCK = 64;
+	static const int TILE = 256;
+
+	double gamma = 0.0;
+
+	int Rows(ManagedArray& x)
+	{
+		return x.y;
+	}
+
+	int Cols(ManagedArray& x)
+	{
+		return x.x;
+	}
+
+	bool SameKernel(Model& a, Model& b)
+	{
+		if (a.Type != b.Type || Cols(a.ModelX) != Cols(b.ModelX) || a.KernelParam.Length() != b.KernelParam.Length())
+			return false;
+
+		for (auto i = 0; i < a.KernelParam.Length(); i++)
+		{
+			if (a.KernelParam(i) != b.KernelParam(i))
+				return false;
+		}
+
+		return true;
+	}
+
+	// scores(k, r) += sum(Coef(k, j) * K(x(r), sv(j))), r0 <= r < r1 computed from the dot
+	// products of each row with a tile of the (transposed) support vectors, which
+	// apply(d, w, nr, s0) turns into kernel values (nr = ||x(r)||^2)
+	template <typename Apply>
+	void ScoreProduct(ManagedArray& x, ManagedArray& scores, int r0, int r1, const Apply& apply)
+	{
+		auto n = Cols(x);
+		auto nsv = Rows(X);
+		auto k = Models();
+
+		auto dist = ManagedArray(TILE, 1, false);
+
+		for (auto s0 = 0; s0 < nsv; s0 += TILE)
+		{
+			auto w = std::min(nsv, s0 + TILE) - s0;
+
+			for (auto r = r0; r < r1; r++)
+			{
+				auto xr = &x(0, r);
+				auto d = &dist(0);
+
+				auto nr = 0.0;
+
+				for (auto c = 0; c < w; c++)
+				{
+					d[c] = 0.0;
+				}
+
+				for (auto f = 0; f < n; f++)
+				{
+					auto xrf = xr[f];
+					auto sv = &Xt(s0, f);
+
+					nr += xrf * xrf;
+
+					for (auto c = 0; c < w; c++)
+					{
+						d[c] += xrf * sv[c];
+					}
+				}
+
+				apply(d, w, nr, s0);
+
+				auto score = &scores(0, r);
+
+				for (auto c = 0; c < w; c++)
+				{
+					auto coef = &Coef(0, s0 + c);
+
+					for (auto i = 0; i < k; i++)
+					{
+						score[i] += coef[i] * d[c];
+					}
+				}
+			}
+		}
+
+		ManagedOps::Free(dist);
+	}
+
+	// RBF kernels: exponentials of the squared distances ||x||^2 + ||sv||^2 - 2 x.sv
+	void ScoreRBF(ManagedArray& x, ManagedArray& scores, int r0, int r1)
+	{
+		ScoreProduct(x, scores, r0, r1, [this](double* d, int w, double nr, int s0)
+		{
+			for (auto c = 0; c < w; c++)
+			{
+				d[c] = KernelFunction::RBF(Type, gamma, nr + Norms(s0 + c) - 2 * d[c]);
+			}
+		});
+	}
+
+	// Kernels of the dot product (Polynomial, Sigmoid)
+	template <typename Kernel>
+	void ScoreDot(const Kernel& kernel, ManagedArray& x, ManagedArray& scores, int r0, int r1)
+	{
+		auto n = Cols(x);
+
+		ScoreProduct(x, scores, r0, r1, [&kernel, n](double* d, int w, double /* nr */, int /* s0 */)
+		{
+			for (auto c = 0; c < w; c++)
+			{
+				d[c] = kernel.FromDot(d[c], n);
+			}
+		});
+	}
+
+	// Fourier kernel: the kernel values of each row with a tile of the (transposed)
+	// support vectors are computed together, one feature at a time
+	void ScoreFourier(ManagedArray& x, ManagedArray& scores, int r0, int r1)
+	{
+		auto n = Cols(x);
+		auto nsv = Rows(X);
+		auto k = Models();
+
+		auto kernel = KernelFunction::FourierKernel(Param);
+
+		auto values = ManagedArray(TILE, 1, false);
+		auto work = ManagedArray(TILE, 2, false);
+
+		for (auto s0 = 0; s0 < nsv; s0 += TILE)
+		{
+			auto w = std::min(nsv, s0 + TILE) - s0;
+
+			for (auto r = r0; r < r1; r++)
+			{
+				auto d = &values(0);
+
+				kernel.Row(&x(0, r), &Xt(s0, 0), nsv, w, n, d, &work(0));
+
+				auto score = &scores(0, r);
+
+				for (auto c = 0; c < w; c++)
+				{
+					auto coef = &Coef(0, s0 + c);
+
+					for (auto i = 0; i < k; i++)
+					{
+						score[i] += coef[i] * d[c];
+					}
+				}
+			}
+		}
+
+		ManagedOps::Free(values);
+		ManagedOps::Free(work);
+	}
+
+	// Score the rows r0 <= r < r1
+	void Score(ManagedArray& x, ManagedArray& scores, int r0, int r1)
+	{
+		auto k = Models();
+
+		for (auto r = r0; r < r1; r++)
+		{
+			for (auto i = 0; i < k; i++)
+			{
+				scores(i, r) = Type == KernelType::LINEAR ? Linear[i]->Decision(&x(0, r), Cols(x)) : B[i];
+			}
+		}
+
+		switch (Type)
+		{
+		case KernelType::GAUSSIAN:
+		case KernelType::RADIAL:
+			ScoreRBF(x, scores, r0, r1);
+			break;
+		case KernelType::POLYNOMIAL:
+			ScoreDot(KernelFunction::PolynomialKernel(Param), x, scores, r0, r1);
+			break;
+		case KernelType::SIGMOID:
+			ScoreDot(KernelFunction::SigmoidKernel(Param), x, scores, r0, r1);
+			break;
+		case KernelType::FOURIER:
+			ScoreFourier(x, scores, r0, r1);
+			break;
+		default:
+			break;
+		}
+	}
+
+public:
+
+	// Union of the support vectors (and transposed), their squared norms and the coefficients (models x support vectors)
+	ManagedArray X = NULL;
+	ManagedArray Xt = NULL;
+	ManagedArray Norms = NULL;
+	ManagedArray Coef = NULL;
+	ManagedArray Param = NULL;
+	KernelType Type = KernelType::UNKNOWN;
+
+	std::vector<double> B;
+	std::vector<int> Category;
+
+	// Linear models are scored with their own weight vectors
+	std::vector<Model*> Linear;
+
+	MultiModel()
+	{
+
+	}
+
+	int Models()
+	{
+		return (int)Category.size();
+	}
+
+	// Returns false if the models do not share the same kernel (and cannot be combined)
+	bool Setup(std::vector<Model>& models)
+	{
+		Free();
+
+		if (models.empty())
+			return false;
+
+		for (auto i = 1; i < (int)models.size(); i++)
+		{
+			if (!SameKernel(models[0], models[i]))
+				return false;
+		}
+
+		auto k = (int)models.size();
+		auto n = Cols(models[0].ModelX);
+
+		Type = models[0].Type;
+		Param = ManagedArray(models[0].KernelParam.Length());
+
+		ManagedOps::Copy2D(Param, models[0].KernelParam, 0, 0);
+
+		for (auto i = 0; i < k; i++)
+		{
+			B.push_back(models[i].B);
+			Category.push_back(models[i].Category);
+
+			if (Type == KernelType::LINEAR)
+				Linear.push_back(&models[i]);
+		}
+
+		if (Type == KernelType::LINEAR)
+			return true;
+
+		// index of each distinct support vector in the union
+		auto index = std::map<std::vector<double>, int>();
+		auto owner = std::vector<std::vector<int>>(k);
+
+		for (auto i = 0; i < k; i++)
+		{
+			auto& sv = models[i].ModelX;
+
+			for (auto j = 0; j < Rows(sv); j++)
+			{
+				auto key = std::vector<double>(&sv(0, j), &sv(0, j) + n);
+
+				auto it = index.find(key);
+
+				if (it == index.end())
+					it = index.insert(std::make_pair(key, (int)index.size())).first;
+
+				owner[i].push_back(it->second);
+			}
+		}
+
+		auto nsv = (int)index.size();
+
+		X = ManagedArray(n, nsv, false);
+		Xt = ManagedArray(nsv, n, false);
+		Norms = ManagedArray(1, nsv, false);
+		Coef = ManagedArray(k, nsv);
+
+		for (auto it = index.begin(); it != index.end(); it++)
+		{
+			auto norm = 0.0;
+
+			for (auto f = 0; f < n; f++)
+			{
+				X(f, it->second) = it->first[f];
+				Xt(it->second, f) = it->first[f];
+
+				norm += it->first[f] * it->first[f];
+			}
+
+			Norms(it->second) = norm;
+		}
+
+		for (auto i = 0; i < k; i++)
+		{
+			for (auto j = 0; j < (int)owner[i].size(); j++)
+			{
+				Coef(i, owner[i][j]) += models[i].Alpha(j) * models[i].ModelY(j);
+			}
+		}
+
+		auto sigma = Param.Length() > 0 ? Param(0) : 1;
+
+		gamma = KernelFunction::Gamma(sigma);
+
+		return true;
+	}
+
+	// Returns the decision values of all models (models x rows)
+	ManagedArray Predict(ManagedArray& input, int threads = 1)
+	{
+		auto x = ManagedArray(input.x, input.y, input.z, input.i, input.j, false);
+
+		if (Cols(x) == 1)
+		{
+			ManagedMatrix::Transpose(x, input);
+		}
+		else
+		{
+			ManagedOps::Copy2D(x, input, 0, 0);
+		}
+
+		auto m = Rows(x);
+
+		auto scores = ManagedArray(Models(), m, false);
+
+		auto pool = ThreadPool(threads);
+
+		for (auto r0 = 0; r0 < m; r0 += BLOCK)
+		{
+			auto r1 = std::min(m, r0 + BLOCK);
+
+			pool.Submit([this, &x, &scores, r0, r1]()
+			{
+				Score(x, scores, r0, r1);
+			});
+		}
+
+		pool.Run();
+
+		ManagedOps::Free(x);
+
+		return scores;
+	}
+
+	void Free()
+	{
+		ManagedOps::Free(X);
+		ManagedOps::Free(Xt);
+		ManagedOps::Free(Norms);
+		ManagedOps::Free(Coef);
+		ManagedOps::Free(Param);
+
+		B.clear();
+		Category.clear();
+		Linear.clear();
+
+		Type = KernelType::UNKNOWN;
+	}
+};
+#endif
@@ -0,0 +1,334 @@
+#ifndef NYSTROM_HPP
+#define NYSTROM_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "KernelFunction.hpp"
+#include "ManagedArray.hpp"
+#include "ManagedOps.hpp"
+#include "Model.hpp"
+#include "Random.hpp"
+#include "ThreadPool.hpp"
+
+// Nystrom low-rank approximation of the kernel matrix
+//
+// r landmark rows L are sampled from the inputs (uniformly or by k-means++
+// seeding) and K(L, L) is factored as R * R' (Cholesky). The feature map
+// z(x) = inv(R) * K(L, x) then satisfies z(x) . z(y) = K(x, L) * inv(K(L, L)) * K(L, y),
+// which approximates K(x, y), so a linear model trained on z(x) (m x r values)
+// replaces the kernel model without the m x m kernel matrix. Landmarks whose
+// pivot vanishes (duplicates, or a kernel that is not positive definite) are
+// dropped, so Rank may be less than r.
+//
+// Since w . z(x) = (inv(R') * w) . K(L, x), the trained linear model is
+// expanded back into a kernel model with the landmarks as its support vectors.
+//
+// See: C.K.I. Williams and M. Seeger, "Using the Nystrom method to speed up
+// kernel machines". Advances in Neural Information Processing Systems, 2001.
+class Nystrom
+{
+private:
+
+	// Rows transformed per task
+	static const int BLOCK = 256;
+
+	// landmarks (n x Rank) and the lower triangular factor R, row k at &factor(0, k)
+	ManagedArray landmarks = NULL;
+	ManagedArray factor = NULL;
+	ManagedArray param = NULL;
+
+	KernelType type = KernelType::UNKNOWN;
+	int n = 0;
+
+	int Rows(ManagedArray& x)
+	{
+		return x.y;
+	}
+
+	int Cols(ManagedArray& x)
+	{
+		return x.x;
+	}
+
+	// r distinct rows sampled uniformly (partial Fisher-Yates shuffle)
+	std::vector<int> Uniform(ManagedArray& x, int r, Random& random)
+	{
+		auto m = Rows(x);
+
+		auto index = std::vector<int>(m);
+
+		for (auto i = 0; i < m; i++)
+		{
+			index[i] = i;
+		}
+
+		random.UniformDistribution();
+
+		for (auto i = 0; i < r; i++)
+		{
+			auto j = i + std::min(m - i - 1, (int)(random.NextDouble() * (m - i)));
+
+			std::swap(index[i], index[j]);
+		}
+
+		index.resize(r);
+
+		return index;
+	}
+
+	// k-means++ seeding: each landmark is sampled with probability proportional
+	// to its squared distance from the nearest landmark chosen so far
+	std::vector<int> KMeans(ManagedArray& x, int r, Random& random)
+	{
+		auto m = Rows(x);
+
+		random.UniformDistribution();
+
+		auto index = std::vector<int>(1, std::min(m - 1, (int)(random.NextDouble() * m)));
+		auto distance = std::vector<double>(m);
+
+		for (auto i = 0; i < m; i++)
+		{
+			distance[i] = KernelFunction::SquaredDiff(&x(0, i), &x(0, index[0]), Cols(x));
+		}
+
+		while ((int)index.size() < r)
+		{
+			auto total = 0.0;
+
+			for (auto i = 0; i < m; i++)
+			{
+				total += distance[i];
+			}
+
+			// all remaining rows coincide with a landmark
+			if (!(total > 0))
+				break;
+
+			auto target = random.NextDouble() * total;
+			auto next = m - 1;
+
+			for (auto i = 0; i < m; i++)
+			{
+				target -= distance[i];
+
+				if (target < 0 && distance[i] > 0)
+				{
+					next = i;
+
+					break;
+				}
+			}
+
+			index.push_back(next);
+
+			for (auto i = 0; i < m; i++)
+			{
+				distance[i] = std::min(distance[i], KernelFunction::SquaredDiff(&x(0, i), &x(0, next), Cols(x)));
+			}
+		}
+
+		return index;
+	}
+
+public:
+
+	int Rank = 0;
+
+	Nystrom()
+	{
+
+	}
+
+	// Sample r landmarks from the rows of x and factor their kernel matrix.
+	// Returns false if no landmark could be kept.
+	bool Setup(ManagedArray& x, KernelType kernel, ManagedArray& kernelParam, int r, bool kmeans, Random& random)
+	{
+		Free();
+
+		n = Cols(x);
+		type = kernel;
+		r = std::min(r, Rows(x));
+
+		param = ManagedArray(kernelParam.Length());
+
+		ManagedOps::Copy2D(param, kernelParam, 0, 0);
+
+		if (r <= 0)
+			return false;
+
+		auto index = kmeans ? KMeans(x, r, random) : Uniform(x, r, random);
+
+		r = (int)index.size();
+
+		auto K = ManagedArray(r, r, false);
+
+		for (auto i = 0; i < r; i++)
+		{
+			for (auto j = 0; j <= i; j++)
+			{
+				K(i, j) = K(j, i) = KernelFunction::Run(type, &x(0, index[i]), &x(0, index[j]), n, param);
+			}
+		}
+
+		auto scale = 0.0;
+
+		for (auto i = 0; i < r; i++)
+		{
+			scale = std::max(scale, std::abs(K(i, i)));
+		}
+
+		// Cholesky factorization, row by row, skipping the landmarks with a (numerically) zero pivot
+		auto R = ManagedArray(r, r);
+		auto kept = std::vector<int>();
+
+		for (auto i = 0; i < r; i++)
+		{
+			auto row = &R(0, Rank);
+
+			for (auto k = 0; k < Rank; k++)
+			{
+				row[k] = (K(kept[k], i) - KernelFunction::Dot(row, &R(0, k), k)) / R(k, k);
+			}
+
+			auto pivot = K(i, i) - KernelFunction::Dot(row, row, Rank);
+
+			if (pivot > 1e-10 * scale)
+			{
+				row[Rank] = std::sqrt(pivot);
+
+				kept.push_back(i);
+
+				Rank++;
+			}
+			else
+			{
+				for (auto k = 0; k < Rank; k++)
+				{
+					row[k] = 0.0;
+				}
+			}
+		}
+
+		landmarks = ManagedArray(n, Rank, false);
+		factor = ManagedArray(Rank, Rank);
+
+		for (auto k = 0; k < Rank; k++)
+		{
+			for (auto f = 0; f < n; f++)
+			{
+				landmarks(f, k) = x(f, index[kept[k]]);
+			}
+
+			for (auto j = 0; j <= k; j++)
+			{
+				factor(j, k) = R(j, k);
+			}
+		}
+
+		ManagedOps::Free(K);
+		ManagedOps::Free(R);
+
+		return Rank > 0;
+	}
+
+	// z = inv(R) * K(L, x) (forward substitution in place)
+	void Transform(const double* x, double* z) const
+	{
+		for (auto k = 0; k < Rank; k++)
+		{
+			auto row = &factor(0, k);
+
+			z[k] = (KernelFunction::Run(type, &landmarks(0, k), x, n, param) - KernelFunction::Dot(row, z, k)) / row[k];
+		}
+	}
+
+	// Map each row of x into a row of Rank features
+	ManagedArray Transform(ManagedArray& x, int threads = 1)
+	{
+		auto m = Rows(x);
+
+		auto z = ManagedArray(Rank, m, false);
+
+		auto pool = ThreadPool(threads);
+
+		for (auto r0 = 0; r0 < m; r0 += BLOCK)
+		{
+			auto r1 = std::min(m, r0 + BLOCK);
+
+			pool.Submit([this, &x, &z, r0, r1]()
+			{
+				for (auto r = r0; r < r1; r++)
+				{
+					Transform(&x(0, r), &z(0, r));
+				}
+			});
+		}
+
+		pool.Run();
+
+		return z;
+	}
+
+	// Kernel model over the landmarks equivalent to a linear model trained on the features
+	Model Expand(Model& linear)
+	{
+		// beta = inv(R') * w (back substitution)
+		auto beta = std::vector<double>(Rank);
+
+		for (auto k = Rank - 1; k >= 0; k--)
+		{
+			auto sum = linear.W(k);
+
+			for (auto i = k + 1; i < Rank; i++)
+			{
+				sum -= factor(k, i) * beta[i];
+			}
+
+			beta[k] = sum / factor(k, k);
+		}
+
+		auto x = ManagedArray(n, Rank, false);
+		auto y = ManagedArray(1, Rank, false);
+		auto alpha = ManagedArray(1, Rank, false);
+		auto w = ManagedArray(1, n);
+		auto kernelParam = ManagedArray(param.Length());
+
+		ManagedOps::Copy2D(x, landmarks, 0, 0);
+		ManagedOps::Copy2D(kernelParam, param, 0, 0);
+
+		for (auto k = 0; k < Rank; k++)
+		{
+			y(k) = beta[k] < 0 ? -1.0 : 1.0;
+			alpha(k) = std::abs(beta[k]);
+
+			for (auto f = 0; f < n; f++)
+			{
+				w(f) += beta[k] * x(f, k);
+			}
+		}
+
+		auto model = Model(x, y, type, kernelParam, alpha, w, linear.B, linear.C, linear.Tolerance, linear.Category, linear.Passes);
+
+		model.Iterations = linear.Iterations;
+		model.MaxIterations = linear.MaxIterations;
+		model.Min = linear.Min;
+		model.Max = linear.Max;
+
+		return model;
+	}
+
+	void Free()
+	{
+		ManagedOps::Free(landmarks);
+		ManagedOps::Free(factor);
+		ManagedOps::Free(param);
+
+		type = KernelType::UNKNOWN;
+		Rank = 0;
+		n = 0;
+	}
+};
+#endif
@@ -0,0 +1,167 @@
+#ifndef RANDOM_FEATURES_HPP
+#define RANDOM_FEATURES_HPP
+
+#include <cmath>
+#include <vector>
+
+#include "ManagedArray.hpp"
+#include "Random.hpp"
+
+// Random Fourier features for the Gaussian kernel
+//
+// z(x) = sqrt(2 / D) * cos(Omega * x + Phase) with Omega ~ N(0, 1 / sigma^2)
+// and Phase ~ U(0, 2 pi), so that z(x) . z(y) approximates
+// exp(-||x - y||^2 / (2 sigma^2)). A linear model trained on z(x) then
+// replaces the Gaussian model. The mapping is generated from (Inputs, D,
+// Sigma, Seed) so only these need to be saved with the model. Omega and Phase
+// are built from the raw mt19937_64 output (whose sequence is fixed by the
+// standard) rather than std::normal_distribution and std::uniform_real_distribution,
+// whose output is implementation-defined, so a saved model rebuilds the same
+// mapping with any standard library.
+//
+// See: A. Rahimi and B. Recht, "Random features for large-scale kernel
+// machines". Advances in Neural Information Processing Systems, 2007.
+class RandomFeatures
+{
+private:
+
+	// Omega (one row of Inputs values per feature) and Phase
+	std::vector<double> omega;
+	std::vector<double> phase;
+
+	double scale = 0.0;
+
+	// Uniform in [0, 1) from the 53 high bits of the generator
+	static double Uniform(std::mt19937_64& generator)
+	{
+		return (double)(generator() >> 11) * (1.0 / 9007199254740992.0);
+	}
+
+	// Pair of independent N(0, 1) values (Box-Muller transform)
+	static void Normal(std::mt19937_64& generator, double& z0, double& z1)
+	{
+		auto r = std::sqrt(-2.0 * std::log(1.0 - Uniform(generator)));
+		auto t = 8.0 * std::atan(1.0) * Uniform(generator);
+
+		z0 = r * std::cos(t);
+		z1 = r * std::sin(t);
+	}
+
+public:
+
+	int Inputs = 0;
+	int D = 0;
+	int Seed = 0;
+	double Sigma = 1.0;
+
+	RandomFeatures()
+	{
+
+	}
+
+	bool Active() const
+	{
+		return D > 0;
+	}
+
+	// Returns false (and leaves the mapping inactive) unless d > 0 and sigma != 0
+	bool Setup(int inputs, int d, double sigma, int seed)
+	{
+		Free();
+
+		if (d <= 0 || !(std::abs(sigma) > 0))
+			return false;
+
+		Inputs = inputs;
+		D = d;
+		Sigma = sigma;
+		Seed = seed;
+
+		auto random = Random(seed);
+
+		omega.resize((size_t)D * Inputs);
+
+		for (auto i = 0; i < (int)omega.size(); i += 2)
+		{
+			double z0, z1;
+
+			Normal(random.generator, z0, z1);
+
+			omega[i] = z0 / std::abs(sigma);
+
+			if (i + 1 < (int)omega.size())
+				omega[i + 1] = z1 / std::abs(sigma);
+		}
+
+		phase.resize(D);
+
+		for (auto i = 0; i < D; i++)
+		{
+			phase[i] = 8.0 * std::atan(1.0) * Uniform(random.generator);
+		}
+
+		scale = std::sqrt(2.0 / D);
+
+		return true;
+	}
+
+	// Feature k of z(x)
+	double Feature(const double* x, int k) const
+	{
+		auto w = &omega[(size_t)k * Inputs];
+
+		auto dot = phase[k];
+
+		for (auto i = 0; i < Inputs; i++)
+		{
+			dot += w[i] * x[i];
+		}
+
+		return scale * std::cos(dot);
+	}
+
+	// z = z(x)
+	void Transform(const double* x, double* z) const
+	{
+		for (auto k = 0; k < D; k++)
+		{
+			z[k] = Feature(x, k);
+		}
+	}
+
+	// Map each row of x (Inputs x rows) into a row of D features
+	ManagedArray Transform(ManagedArray& x) const
+	{
+		auto z = ManagedArray(D, x.y, false);
+
+		for (auto r = 0; r < x.y; r++)
+		{
+			Transform(&x(0, r), &z(0, r));
+		}
+
+		return z;
+	}
+
+	// w . z(x) + b without storing z(x)
+	double Decision(const double* x, const double* w, double b) const
+	{
+		auto sum = b;
+
+		for (auto k = 0; k < D; k++)
+		{
+			sum += w[k] * Feature(x, k);
+		}
+
+		return sum;
+	}
+
+	void Free()
+	{
+		omega.clear();
+		phase.clear();
+
+		Inputs = 0;
+		D = 0;
+	}
+};
+#endif
@@ -0,0 +1,6 @@
+#ifndef SOLVER_TYPES_HPP
+#define SOLVER_TYPES_HPP
+
+enum SolverType { SMO = 0, WSS2 = 1 };
+
+#endif
@@ -2,19 +2,28 @@
 #include <cmath>
 #include <cstdlib>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <stdexcept>
 #include <string>
 
+#include "CompiledModel.hpp"
+#include "KDTree.hpp"
 #include "KernelTypes.hpp"
 #include "KernelFunction.hpp"
+#include "KernelMatrix.hpp"
 #include "Model.hpp"
+#include "MultiModel.hpp"
+#include "Nystrom.hpp"
+#include "RandomFeatures.hpp"
 
 #include "ManagedFile.hpp"
 #include "ManagedUtil.hpp"
 
 #include "Profiler.hpp"
 #include "Random.hpp"
+#include "SolverTypes.hpp"
+#include "ThreadPool.hpp"
 
 void ParseInt(std::string arg, const char* str, const char* var, int& dst)
 {
@@ -278,7 +287,44 @@ void Load2D(std::string filename, ManagedArray& input, const char* delimiter, in
 	file.close();
 }
 
-void SVMTrainer(std::string InputData, int delimiter, KernelType kernel, std::vector<double> kernelParams, int category, double c, int passes, double tolerance, bool save, std::string SaveDirectory, std::string SaveJSON)
+void PrintCacheStatistics(Model& model)
+{
+	std::cerr << "... Kernel cache (category " << model.Category << "): " << model.Cache.Hits << " hits, " << model.Cache.Misses << " misses, hit rate = " << std::fixed << std::setprecision(2) << model.Cache.HitRate() * 100.0 << "%, miss rate = " << model.Cache.MissRate() * 100.0 << "%" << std::endl;
+}
+
+// Warn when the simplified SMO solver runs with a cache smaller than the kernel matrix
+void CheckCache(int examples, double size, bool packed, bool single, SolverType solver)
+{
+	if (size <= 0 || packed || solver != SolverType::SMO)
+		return;
+
+	auto columns = KernelCache::Columns(examples, size, single);
+
+	if (columns < examples)
+	{
+		std::cerr << "... Warning: the kernel cache holds " << columns << " of " << examples << " columns and SMO selects examples at random, so most columns will be recomputed (use /SOLVER=WSS2 or a larger /CACHE)" << std::endl;
+	}
+}
+
+// Default kernel cache (MB) for a linear model trained on approximate kernel
+// features: the kernel matrix of the features is pre-computed (once, for all
+// the models) if it fits within the default budget, otherwise its columns are
+// cached within that budget
+int FeatureCache(int examples, bool single)
+{
+	const int DEFAULT_CACHE = 100;
+
+	auto size = (double)examples * examples * (single ? sizeof(float) : sizeof(double)) / (1024.0 * 1024.0);
+
+	return size <= DEFAULT_CACHE ? 0 : DEFAULT_CACHE;
+}
+
+void PrintShrinkingStatistics(Model& model)
+{
+	std::cerr << "... Shrinking (category " << model.Category << "): " << model.Iterations << " iterations, " << model.Shrinks << " examples shrunk, " << model.Unshrinks << " unshrinks" << std::endl;
+}
+
+void SVMTrainer(std::string InputData, int delimiter, KernelType kernel, std::vector<double> kernelParams, int category, double c, int passes, double tolerance, int cache, bool packed, bool single, SolverType solver, bool shrinking, int threads, int seed, int rff, int landmarks, bool kmeans, bool save, std::string SaveDirectory, std::string SaveJSON)
 {
 	std::string BaseDirectory = "./";
 
@@ -297,6 +343,75 @@ void SVMTrainer(std::string InputData, int delimiter, KernelType kernel, std::ve
 
 		if (Inputs > 0 && Categories > 0 && Examples > 0 && kernel != KernelType::UNKNOWN)
 		{
+			// Gaussian kernel approximated by a linear model on random Fourier features
+			auto map = RandomFeatures();
+			auto features = input;
+
+			if (rff > 0)
+			{
+				if (kernel == KernelType::GAUSSIAN && kernelParams.size() > 0 && kernelParams[0] > 0 && map.Setup(Inputs, rff, kernelParams[0], seed >= 0 ? seed : (int)(Random().generator() % std::numeric_limits<int>::max())))
+				{
+					std::cerr << std::endl << "Mapping inputs to " << rff << " random Fourier features (seed = " << map.Seed << ")" << std::endl;
+
+					features = map.Transform(input);
+
+					kernel = KernelType::LINEAR;
+					kernelParams.clear();
+
+					// only cache the linear kernel columns if the kernel matrix of the features is too large
+					if (cache <= 0 && !packed)
+					{
+						cache = FeatureCache(Examples, single);
+
+						if (cache > 0)
+							std::cerr << "... Kernel cache size set to " << cache << " MB" << std::endl;
+					}
+				}
+				else
+				{
+					std::cerr << std::endl << "Random Fourier features require a Gaussian kernel with sigma > 0, ignoring /RFF" << std::endl;
+				}
+			}
+
+			// kernel approximated by a linear model on Nystrom features (expanded back into a kernel model over the landmarks)
+			auto nystrom = Nystrom();
+
+			if (landmarks > 0 && !map.Active())
+			{
+				auto params = ManagedArray((int)kernelParams.size());
+
+				for (auto i = 0; i < params.Length(); i++)
+				{
+					params(i) = kernelParams[i];
+				}
+
+				auto random = seed >= 0 ? Random(seed) : Random();
+
+				if (kernel != KernelType::LINEAR && nystrom.Setup(input, kernel, params, landmarks, kmeans, random))
+				{
+					std::cerr << std::endl << "Mapping inputs to " << nystrom.Rank << " Nystrom features (" << (kmeans ? "k-means++" : "uniform") << " landmarks)" << std::endl;
+
+					features = nystrom.Transform(input, threads);
+
+					kernel = KernelType::LINEAR;
+					kernelParams.clear();
+
+					if (cache <= 0 && !packed)
+					{
+						cache = FeatureCache(Examples, single);
+
+						if (cache > 0)
+							std::cerr << "... Kernel cache size set to " << cache << " MB" << std::endl;
+					}
+				}
+				else
+				{
+					std::cerr << std::endl << "Nystrom approximation requires a non-linear kernel, ignoring /NYSTROM" << std::endl;
+				}
+
+				ManagedOps::Free(params);
+			}
+
 			if (category > 0 && category <= Categories)
 			{
 				auto params = ManagedArray((int)kernelParams.size());
@@ -310,16 +425,50 @@ void SVMTrainer(std::string InputData, int delimiter, KernelType kernel, std::ve
 
 				auto model = Model();
 
+				CheckCache(Examples, cache, packed, single, solver);
+
+				model.CacheSize = cache;
+				model.Solver = solver;
+				model.Shrinking = shrinking;
+				model.Threads = threads;
+				model.Packed = packed;
+				model.Single = single;
 				model.GetNormalization(input);
 
+				if (seed >= 0)
+				{
+					model.random = Random(seed + category);
+				}
+
 				std::cerr << std::endl << "Training Model..." << std::endl;
 
-				model.Train(input, output, c, kernel, params, tolerance, passes, category);
+				model.Train(features, output, c, kernel, params, tolerance, passes, category);
 
 				std::cerr << "Training Done" << std::endl;
 
 				std::cerr << "elapsed time is " << Profiler::Elapsed(start) << " ms" << std::endl;
 
+				model.Map = map;
+
+				if (cache > 0)
+				{
+					PrintCacheStatistics(model);
+				}
+
+				if (solver == SolverType::WSS2 && shrinking)
+				{
+					PrintShrinkingStatistics(model);
+				}
+
+				if (nystrom.Rank > 0)
+				{
+					auto expanded = nystrom.Expand(model);
+
+					model.Free();
+
+					model = expanded;
+				}
+
 				if (save && SaveJSON.length() > 0)
 				{
 					std::cerr << std::endl << "Saving Model Parameters" << std::endl;
@@ -344,40 +493,91 @@ void SVMTrainer(std::string InputData, int delimiter, KernelType kernel, std::ve
 
 				auto start = Profiler::now();
 
+				// The kernel matrix does not depend on the labels so it is shared by all models
+				auto gram = KernelMatrix();
+
+				gram.Setup(features, kernel, params, cache <= 0 || packed, threads, packed, single);
+
+				// /CACHE is the total budget: it is split between the models trained at the same time
+				auto budget = (double)cache / std::max(1, std::min(threads, Categories));
+
+				CheckCache(Examples, budget, packed, single, solver);
+
 				for (auto i = 0; i < Categories; i++)
 				{
 					auto model = Model();
 
+					model.CacheSize = budget;
+					model.Solver = solver;
+					model.Shrinking = shrinking;
 					model.GetNormalization(input);
-					model.Setup(input, output, c, kernel, params, tolerance, passes, i + 1);
+
+					// Each model has its own random number stream
+					if (seed >= 0)
+					{
+						model.random = Random(seed + i + 1);
+					}
+
+					model.Setup(gram, output, c, tolerance, passes, i + 1);
 					models.push_back(model);
 				}
 
-				auto done = false;
-
 				std::cerr << std::endl << "Training Models..." << std::endl;
 
-				while (!done)
+				// Each category is trained as an independent task
+				auto pool = ThreadPool(threads);
+
+				for (auto i = 0; i < (int)models.size(); i++)
 				{
-					done = true;
+					auto model = &models[i];
 
-					for (auto i = 0; i < models.size(); i++)
+					pool.Submit([model]()
 					{
-						auto result = models[i].Step();
-
-						if (result && !models[i].Trained)
-						{
-							models[i].Generate();
-						}
+						while (!model->Step()) { }
 
-						done &= result;
-					}
+						model->Generate();
+					});
 				}
 
+				pool.Run();
+
 				std::cerr << "Training Done" << std::endl;
 
 				std::cerr << "elapsed time is " << Profiler::Elapsed(start) << " ms" << std::endl;
 
+				for (auto i = 0; i < models.size(); i++)
+				{
+					models[i].Map = map;
+				}
+
+				if (cache > 0)
+				{
+					for (auto i = 0; i < models.size(); i++)
+					{
+						PrintCacheStatistics(models[i]);
+					}
+				}
+
+				if (solver == SolverType::WSS2 && shrinking)
+				{
+					for (auto i = 0; i < models.size(); i++)
+					{
+						PrintShrinkingStatistics(models[i]);
+					}
+				}
+
+				if (nystrom.Rank > 0)
+				{
+					for (auto i = 0; i < models.size(); i++)
+					{
+						auto expanded = nystrom.Expand(models[i]);
+
+						models[i].Free();
+
+						models[i] = expanded;
+					}
+				}
+
 				if (save && SaveJSON.length() > 0)
 				{
 					std::cerr << std::endl << "Saving Model Parameters" << std::endl;
@@ -391,7 +591,17 @@ void SVMTrainer(std::string InputData, int delimiter, KernelType kernel, std::ve
 				{
 					models[i].Free();
 				}
+
+				gram.Free();
+			}
+
+			if (map.Active() || nystrom.Rank > 0)
+			{
+				ManagedOps::Free(features);
 			}
+
+			map.Free();
+			nystrom.Free();
 		}
 
 		ManagedOps::Free(input);
@@ -399,7 +609,7 @@ void SVMTrainer(std::string InputData, int delimiter, KernelType kernel, std::ve
 	}
 }
 
-void SVMPredict(std::string InputData, std::string ModelFile, int delimiter, int Features, bool save, std::string SaveDirectory, std::string ClassificationFile)
+void SVMPredict(std::string InputData, std::string ModelFile, int delimiter, int Features, int threads, double epsilon, double accuracy, bool save, std::string SaveDirectory, std::string ClassificationFile)
 {
 	std::string BaseDirectory = "./";
 
@@ -420,27 +630,172 @@ void SVMPredict(std::string InputData, std::string ModelFile, int delimiter, int
 			auto classification = ManagedIntList(Samples);
 			ManagedOps::Set(classification, 0);
 
+			// Index the support vectors of Gaussian / Radial models
+			auto trees = std::vector<KDTree>();
+
+			if (epsilon > 0)
+			{
+				for (auto i = 0; i < (int)models.size(); i++)
+				{
+					auto tree = KDTree();
+
+					if (!tree.Setup(models[i]))
+					{
+						std::cerr << std::endl << "Model " << (i + 1) << " does not use a Gaussian or Radial kernel, spatial index disabled" << std::endl;
+
+						for (auto t = 0; t < (int)trees.size(); t++)
+							trees[t].Free();
+
+						trees.clear();
+
+						break;
+					}
+
+					trees.push_back(tree);
+				}
+			}
+
 			std::cerr << std::endl << "Classifying input data..." << std::endl;
 
 			auto start = Profiler::now();
 
-			for (auto i = 0; i < (int)models.size(); i++)
+			auto multi = MultiModel();
+
+			if (!trees.empty())
 			{
-				std::cerr << std::endl << "Using model " << (i + 1) << "..." << std::endl;
+				std::cerr << std::endl << "Using " << trees.size() << " spatial indices (epsilon = " << epsilon << ")..." << std::endl;
 
-				auto p = models[i].Predict(input);
+				// each task scores its own slice of the input and keeps its largest error bound
+				auto pool = ThreadPool(threads);
+				auto slice = 256;
+				auto errors = std::vector<double>((Samples + slice - 1) / slice, 0.0);
 
-				for (auto y = 0; y < p.Length(); y++)
+				for (auto y0 = 0; y0 < Samples; y0 += slice)
 				{
-					if (p(y) > prediction(y))
+					auto y1 = std::min(Samples, y0 + slice);
+
+					pool.Submit([&trees, &input, &prediction, &classification, &errors, epsilon, slice, y0, y1]()
+					{
+						for (auto y = y0; y < y1; y++)
+						{
+							for (auto i = 0; i < (int)trees.size(); i++)
+							{
+								auto error = 0.0;
+								auto p = trees[i].Decision(&input(0, y), epsilon, error);
+
+								errors[y0 / slice] = std::max(errors[y0 / slice], error);
+
+								if (p > prediction(y))
+								{
+									prediction(y) = p;
+									classification(y) = trees[i].Category;
+								}
+							}
+						}
+					});
+				}
+
+				pool.Run();
+
+				std::cerr << "... Maximum decision value error bound = " << *std::max_element(errors.begin(), errors.end()) << std::endl;
+			}
+			else if (accuracy > 0 && models.size() > 0 && models[0].Type == KernelType::GAUSSIAN)
+			{
+				for (auto i = 0; i < (int)models.size(); i++)
+				{
+					std::cerr << std::endl << "Using model " << (i + 1) << "..." << std::endl;
+
+					models[i].Accuracy = accuracy;
+					models[i].Threads = threads;
+
+					auto p = models[i].Predict(input);
+
+					if (models[i].FGT.Faster())
+						std::cerr << "... Fast Gauss Transform: " << models[i].FGT.Clusters << " clusters, order " << models[i].FGT.Order() << ", error bound = " << models[i].FGT.Bound() << std::endl;
+					else
+						std::cerr << "... Fast Gauss Transform would not be faster than the direct sum, using exact decision values" << std::endl;
+
+					for (auto y = 0; y < p.Length(); y++)
 					{
-						prediction(y) = p(y);
-						classification(y) = models[i].Category;
+						if (p(y) > prediction(y))
+						{
+							prediction(y) = p(y);
+							classification(y) = models[i].Category;
+						}
 					}
+
+					ManagedOps::Free(p);
 				}
+			}
+			else if (multi.Setup(models))
+			{
+				std::cerr << std::endl << "Using " << multi.Models() << " models (" << multi.X.y << " unique support vectors)..." << std::endl;
+
+				auto scores = multi.Predict(input, threads);
 
-				ManagedOps::Free(p);
+				for (auto y = 0; y < Samples; y++)
+				{
+					for (auto i = 0; i < multi.Models(); i++)
+					{
+						if (scores(i, y) > prediction(y))
+						{
+							prediction(y) = scores(i, y);
+							classification(y) = multi.Category[i];
+						}
+					}
+				}
 
+				ManagedOps::Free(scores);
+			}
+			else
+			{
+				for (auto i = 0; i < (int)models.size(); i++)
+				{
+					std::cerr << std::endl << "Using model " << (i + 1) << "..." << std::endl;
+
+					auto model = CompiledModel(models[i]);
+					auto p = ManagedArray(1, Samples);
+
+					// each task scores its own slice of the input
+					auto pool = ThreadPool(threads);
+					auto slice = 256;
+
+					for (auto y0 = 0; y0 < Samples; y0 += slice)
+					{
+						auto rows = std::min(Samples, y0 + slice) - y0;
+
+						pool.Submit([&model, &input, &p, y0, rows]()
+						{
+							model.Predict(&input(0, y0), rows, &p(y0));
+						});
+					}
+
+					pool.Run();
+
+					for (auto y = 0; y < p.Length(); y++)
+					{
+						if (p(y) > prediction(y))
+						{
+							prediction(y) = p(y);
+							classification(y) = models[i].Category;
+						}
+					}
+
+					ManagedOps::Free(p);
+
+					model.Free();
+				}
+			}
+
+			multi.Free();
+
+			for (auto i = 0; i < (int)trees.size(); i++)
+			{
+				trees[i].Free();
+			}
+
+			for (auto i = 0; i < (int)models.size(); i++)
+			{
 				models[i].Free();
 			}
 
@@ -473,6 +828,18 @@ int main(int argc, char** argv)
 	auto tolerance = 0.0001;
 	auto type = KernelType::UNKNOWN;
 	auto category = 0;
+	auto cache = 0;
+	auto packed = false;
+	auto single = false;
+	auto solver = SolverType::SMO;
+	auto shrinking = true;
+	auto threads = 1;
+	auto epsilon = 0.0;
+	auto accuracy = 0.0;
+	auto seed = -1;
+	auto rff = 0;
+	auto landmarks = 0;
+	auto kmeans = false;
 	std::vector<double> parameters;
 
 	// Prediction
@@ -546,6 +913,54 @@ int main(int argc, char** argv)
 
 			std::cerr << "... Kernel type = Fourier basis functions" << std::endl;
 		}
+		else if (!arg.compare("/SOLVER=SMO"))
+		{
+			solver = SolverType::SMO;
+
+			std::cerr << "... Solver = Simplified SMO" << std::endl;
+		}
+		else if (!arg.compare("/SOLVER=WSS2"))
+		{
+			solver = SolverType::WSS2;
+
+			std::cerr << "... Solver = SMO with second order working set selection" << std::endl;
+		}
+		else if (!arg.compare("/LANDMARKS=UNIFORM"))
+		{
+			kmeans = false;
+
+			std::cerr << "... Nystrom landmarks sampled uniformly" << std::endl;
+		}
+		else if (!arg.compare("/LANDMARKS=KMEANS"))
+		{
+			kmeans = true;
+
+			std::cerr << "... Nystrom landmarks sampled by k-means++ seeding" << std::endl;
+		}
+		else if (!arg.compare("/PACKED"))
+		{
+			packed = true;
+
+			std::cerr << "... Packed (upper triangular) kernel matrix" << std::endl;
+		}
+		else if (!arg.compare("/PRECISION=FLOAT"))
+		{
+			single = true;
+
+			std::cerr << "... Kernel matrix precision = float" << std::endl;
+		}
+		else if (!arg.compare("/PRECISION=DOUBLE"))
+		{
+			single = false;
+
+			std::cerr << "... Kernel matrix precision = double" << std::endl;
+		}
+		else if (!arg.compare("/NOSHRINKING"))
+		{
+			shrinking = false;
+
+			std::cerr << "... Shrinking disabled" << std::endl;
+		}
 		else if (!arg.compare("/TAB"))
 		{
 			delimiter = 0;
@@ -586,9 +1001,16 @@ int main(int argc, char** argv)
 
 		ParseInt(arg, "/PASSES=", "Max # of passes", passes);
 		ParseInt(arg, "/CATEGORY=", "Category", category);
+		ParseInt(arg, "/CACHE=", "Kernel cache size (MB)", cache);
+		ParseInt(arg, "/THREADS=", "# of threads", threads);
+		ParseInt(arg, "/SEED=", "Random number seed", seed);
+		ParseInt(arg, "/RFF=", "# of random Fourier features", rff);
+		ParseInt(arg, "/NYSTROM=", "# of Nystrom landmarks", landmarks);
 		ParseInt(arg, "/FEATURES=", "# features per data point", features);
 		ParseDouble(arg, "/TOLERANCE=", "Error tolerance", tolerance);
 		ParseDouble(arg, "/C=", "Regularization constant", c);
+		ParseDouble(arg, "/EPSILON=", "Spatial index kernel threshold", epsilon);
+		ParseDouble(arg, "/ACCURACY=", "Fast Gauss Transform accuracy", accuracy);
 		ParseDoubles(arg, "/PARAMETERS=", "Kernel Parameters", parameters);
 	}
 
@@ -630,11 +1052,11 @@ int main(int argc, char** argv)
 
 	if (predict)
 	{
-		SVMPredict(InputData, ModelFile, delimiter, features, save, SaveDir, ClassificationFile);
+		SVMPredict(InputData, ModelFile, delimiter, features, threads, epsilon, accuracy, save, SaveDir, ClassificationFile);
 	}
 	else
 	{
-		SVMTrainer(InputData, delimiter, type, parameters, category, c, passes, tolerance, save, SaveDir, SaveJSON);
+		SVMTrainer(InputData, delimiter, type, parameters, category, c, passes, tolerance, cache, packed, single, solver, shrinking, threads, seed, rff, landmarks, kmeans, save, SaveDir, SaveJSON);
 	}
 
 	return 0;
@@ -0,0 +1,154 @@
+#ifndef SYMMETRIC_MATRIX_HPP
+#define SYMMETRIC_MATRIX_HPP
+
+// Symmetric [x][x] matrix stored as a packed upper triangle
+//
+// Row y holds the elements (y, y) ... (y, x - 1) so only x * (x + 1) / 2
+// values are kept, about half of the memory of the full matrix
+template <typename T>
+class SymmetricMatrix
+{
+private:
+
+	T* Data = NULL;
+
+	T* _New(long long size, bool initialize = true)
+	{
+		auto temp = new T[size];
+
+		if (initialize)
+		{
+			for (auto i = 0LL; i < size; i++)
+				temp[i] = 0;
+		}
+
+		return temp;
+	}
+
+	void _Free(T*& mem)
+	{
+		if (mem != NULL)
+		{
+			delete[] mem;
+			mem = NULL;
+		}
+	}
+
+	// Offset of element (y, y) of a size x size matrix
+	static long long Offset(int size, int iy)
+	{
+		return (long long)iy * size - (long long)iy * (iy - 1) / 2;
+	}
+
+	long long Offset(int iy)
+	{
+		return Offset(x, iy);
+	}
+
+public:
+
+	// Column (or row) i read in place: element k is (k, i)
+	class ColumnView
+	{
+	private:
+
+		const T* data = NULL;
+		int size = 0;
+		int i = 0;
+		long long diagonal = 0;
+
+	public:
+
+		ColumnView()
+		{
+
+		}
+
+		ColumnView(const T* data, int size, int i) : data(data), size(size), i(i), diagonal(Offset(size, i))
+		{
+
+		}
+
+		T operator[](int k) const
+		{
+			return k >= i ? data[diagonal + k - i] : data[Offset(size, k) + i - k];
+		}
+
+		// Unpack the whole column into dst
+		template <typename U>
+		void Unpack(U* dst) const
+		{
+			// (k, i) for k < i is in row k: the offset of (k + 1, i) is that of (k, i) plus size - k - 1
+			auto offset = (long long)i;
+
+			for (auto k = 0; k < i; k++)
+			{
+				dst[k] = data[offset];
+
+				offset += size - k - 1;
+			}
+
+			auto row = data + diagonal;
+
+			for (auto k = i; k < size; k++)
+			{
+				dst[k] = row[k - i];
+			}
+		}
+	};
+
+	int x = 0;
+
+	SymmetricMatrix()
+	{
+
+	}
+
+	SymmetricMatrix(int size, bool initialize = true)
+	{
+		Resize(size, initialize);
+	}
+
+	// Element (ix, iy) == (iy, ix)
+	T& operator()(int ix, int iy)
+	{
+		return ix >= iy ? Data[Offset(iy) + ix - iy] : Data[Offset(ix) + iy - ix];
+	}
+
+	ColumnView View(int i)
+	{
+		return ColumnView(Data, x, i);
+	}
+
+	// Unpack column (or row) i into dst
+	template <typename U>
+	void Column(int i, U* dst)
+	{
+		View(i).Unpack(dst);
+	}
+
+	void Resize(int size, bool initialize = true)
+	{
+		_Free(Data);
+
+		x = size;
+
+		Data = _New(Length(), initialize);
+	}
+
+	long long Length()
+	{
+		return (long long)x * (x + 1) / 2;
+	}
+
+	void Free()
+	{
+		_Free(Data);
+
+		x = 0;
+
+		Data = NULL;
+	}
+};
+
+#endif
@@ -0,0 +1,109 @@
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+#include "../CompiledModel.hpp"
+#include "../KDTree.hpp"
+#include "../KernelFunction.hpp"
+#include "../Model.hpp"
+#include "../MultiModel.hpp"
+
+// Every RBF prediction path must agree when the query is one of the support
+// vectors, including sigma = 0 where K = 1 at d = 0 and 0 elsewhere
+int failures = 0;
+
+void Check(const char* path, KernelType type, double sigma, int j, double value, double expected)
+{
+	if (std::abs(value - expected) <= 1e-9 * (1 + std::abs(expected)))
+		return;
+
+	std::cerr << path << " (" << (type == KernelType::GAUSSIAN ? "Gaussian" : "Radial") << ", sigma = " << sigma << ", sv " << j << "): " << value << " != " << expected << std::endl;
+
+	failures++;
+}
+
+void Test(ManagedArray& x, ManagedArray& y, KernelType type, double sigma)
+{
+	auto param = ManagedArray(1);
+
+	param(0) = sigma;
+
+	auto models = std::vector<Model>(1);
+	auto& model = models[0];
+
+	model.Train(x, y, 1.0, type, param);
+
+	auto n = model.ModelX.x;
+	auto nsv = model.ModelX.y;
+
+	auto predictions = model.Predict(model.ModelX);
+
+	auto compiled = CompiledModel(model);
+
+	auto tree = KDTree();
+	tree.Setup(model);
+
+	auto multi = MultiModel();
+	multi.Setup(models);
+
+	auto scores = multi.Predict(model.ModelX);
+
+	for (auto j = 0; j < nsv; j++)
+	{
+		auto sv = &model.ModelX(0, j);
+
+		// the support vectors are distinct: only sv(j) itself contributes if sigma = 0
+		auto expected = sigma != 0 ? predictions(j) : model.B + model.Alpha(j) * model.ModelY(j);
+		auto error = 0.0;
+
+		Check("Kernel", type, sigma, j, KernelFunction::Run(type, sv, sv, n, param), 1.0);
+		Check("Predict", type, sigma, j, predictions(j), expected);
+		Check("Decision", type, sigma, j, model.Decision(sv, n), expected);
+		Check("CompiledModel", type, sigma, j, compiled.Decision(sv), expected);
+		Check("KDTree", type, sigma, j, tree.Decision(sv, 0.0, error), expected);
+		Check("MultiModel", type, sigma, j, scores(0, j), expected);
+		Check("Classify", type, sigma, j, model.Classify(sv, n), expected > 0 ? model.Category : 0);
+	}
+
+	ManagedOps::Free(scores);
+	ManagedOps::Free(predictions);
+	ManagedOps::Free(param);
+
+	multi.Free();
+	tree.Free();
+	compiled.Free();
+	model.Free();
+}
+
+int main()
+{
+	// two classes on a 6 x 6 grid, inside and outside a circle
+	auto m = 36;
+
+	auto x = ManagedArray(2, m);
+	auto y = ManagedArray(1, m);
+
+	for (auto i = 0; i < m; i++)
+	{
+		x(0, i) = i % 6 - 2.5;
+		x(1, i) = i / 6 - 2.5;
+
+		y(i) = x(0, i) * x(0, i) + x(1, i) * x(1, i) < 6 ? 1 : 0;
+	}
+
+	for (auto type : { KernelType::GAUSSIAN, KernelType::RADIAL })
+	{
+		for (auto sigma : { 1.0, 0.0 })
+		{
+			Test(x, y, type, sigma);
+		}
+	}
+
+	ManagedOps::Free(x);
+	ManagedOps::Free(y);
+
+	std::cerr << (failures > 0 ? "FAILED" : "PASSED") << std::endl;
+
+	return failures > 0 ? 1 : 0;
+}
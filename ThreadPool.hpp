@@ -0,0 +1,107 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool of worker threads with work stealing
+//
+// Tasks are distributed round-robin to per-worker queues before Run() is
+// called. Each worker takes tasks from the back of its own queue and, once
+// that is empty, steals from the front of the other queues so that long
+// running tasks do not leave the remaining threads idle.
+class ThreadPool
+{
+private:
+
+	int threads = 1;
+	int next = 0;
+
+	std::vector<std::deque<std::function<void()>>> queues;
+	std::vector<std::mutex> locks;
+
+	bool Take(int id, std::function<void()>& task)
+	{
+		for (auto k = 0; k < threads; k++)
+		{
+			auto victim = (id + k) % threads;
+
+			std::lock_guard<std::mutex> lock(locks[victim]);
+
+			if (!queues[victim].empty())
+			{
+				// own queue from the back, other queues from the front
+				if (victim == id)
+				{
+					task = queues[victim].back();
+
+					queues[victim].pop_back();
+				}
+				else
+				{
+					task = queues[victim].front();
+
+					queues[victim].pop_front();
+				}
+
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void Work(int id)
+	{
+		std::function<void()> task;
+
+		while (Take(id, task))
+		{
+			task();
+		}
+	}
+
+public:
+
+	ThreadPool(int size = 1) : threads(size > 0 ? size : 1), queues(threads), locks(threads)
+	{
+
+	}
+
+	int Threads()
+	{
+		return threads;
+	}
+
+	void Submit(std::function<void()> task)
+	{
+		queues[next].push_back(task);
+
+		next = (next + 1) % threads;
+	}
+
+	// Run all submitted tasks and wait for them to complete
+	void Run()
+	{
+		std::vector<std::thread> workers;
+
+		for (auto i = 1; i < threads; i++)
+		{
+			workers.push_back(std::thread(&ThreadPool::Work, this, i));
+		}
+
+		// the calling thread is worker 0
+		Work(0);
+
+		for (auto i = 0; i < (int)workers.size(); i++)
+		{
+			workers[i].join();
+		}
+
+		next = 0;
+	}
+};
+#endif